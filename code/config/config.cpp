@@ -0,0 +1,307 @@
+#include "config.h"
+#include "../server/webserver.h"
+#include "../pool/compresscache.h"
+#include "../metrics/trace.h"
+using namespace std;
+
+Config::Config()
+    : port(5678), trigMode(3), timeoutMS(60000), optLinger(false),
+      sqlPort(3306), sqlUser("root"), sqlPwd("123456"), dbName("webdb"),
+      connPoolNum(12), threadNum(6), openLog(true), logLevel(1), logQueSize(1024),
+      bundlePath("./bin/resources.pack"), daemonize(false),
+      /* 静态参数的默认值就是各模块当前的取值 */
+      listenBacklog(WebServer::listenBacklog), acceptBatch(WebServer::acceptBatch),
+      eventBatch(WebServer::eventBatch), busyPollUS(WebServer::busyPollUS),
+      sockBusyPollUS(WebServer::sockBusyPollUS), useUring(WebServer::useUring),
+      fileReadThreads(WebServer::fileReadThreads), fileReadBlocks(WebServer::fileReadBlocks),
+      headerTimeoutMS(HttpConn::headerTimeoutMS), writeBudget(HttpConn::writeBudget),
+      maxBodySize(HttpRequest::maxBodySize), maxFormSize(HttpRequest::maxFormSize),
+      maxLineSize(HttpRequest::maxLineSize), maxHeaderSize(HttpRequest::maxHeaderSize),
+      maxHeaderCount(HttpRequest::maxHeaderCount), gzipOnTheFly(HttpResponse::gzipOnTheFly),
+      coldReadMin(HttpResponse::coldReadMin), compressCacheSize(CompressCache::Instance()->Capacity()),
+      drainTimeoutMS(WebServer::drainTimeoutMS), metricsPath(WebServer::metricsPath),
+      traceSample(Tracer::sampleEvery), traceFile(WebServer::traceFile) {
+    options_ = {
+        { "port",               INT,    &port,              false, "监听端口" },
+        { "trig_mode",          INT,    &trigMode,          false, "0 LT+LT, 1 LT+ET, 2 ET+LT, 3 ET+ET (监听+连接)" },
+        { "timeout_ms",         INT,    &timeoutMS,         true,  "连接空闲超时, <= 0 不限制" },
+        { "opt_linger",         BOOL,   &optLinger,         false, "关闭连接时等待数据发送完毕" },
+        { "sql_port",           INT,    &sqlPort,           false, "MySQL 端口" },
+        { "sql_user",           STRING, &sqlUser,           false, "MySQL 用户名" },
+        { "sql_pwd",            STRING, &sqlPwd,            false, "MySQL 密码" },
+        { "db_name",            STRING, &dbName,            false, "MySQL 数据库名" },
+        { "conn_pool_num",      INT,    &connPoolNum,       false, "数据库连接池大小" },
+        { "thread_num",         INT,    &threadNum,         false, "工作线程数" },
+        { "open_log",           BOOL,   &openLog,           false, "是否打开日志" },
+        { "log_level",          INT,    &logLevel,          true,  "日志等级 0 debug, 1 info, 2 warn, 3 error" },
+        { "log_que_size",       INT,    &logQueSize,        false, "异步日志队列容量, 0 为同步写" },
+        { "bundle_path",        STRING, &bundlePath,        false, "静态资源包, 为空不使用" },
+        { "daemon",             BOOL,   &daemonize,         false, "以守护进程运行" },
+        { "listen_backlog",     INT,    &listenBacklog,     false, "监听队列长度" },
+        { "accept_batch",       INT,    &acceptBatch,       true,  "每次监听事件最多接受的连接数, <= 0 取到 EAGAIN" },
+        { "event_batch",        INT,    &eventBatch,        false, "每次等待最多取回的事件数" },
+        { "busy_poll_us",       INT,    &busyPollUS,        true,  "阻塞等待前忙轮询的微秒数" },
+        { "sock_busy_poll_us",  INT,    &sockBusyPollUS,    true,  "已连接套接字的 SO_BUSY_POLL" },
+        { "use_uring",          BOOL,   &useUring,          false, "事件后端使用 io_uring" },
+        { "file_read_threads",  INT,    &fileReadThreads,   false, "冷文件读线程数, 0 总是 mmap" },
+        { "file_read_blocks",   SIZE,   &fileReadBlocks,    false, "冷文件缓冲块总数" },
+        { "header_timeout_ms",  INT,    &headerTimeoutMS,   true,  "读完请求头的期限, <= 0 不限制" },
+        { "write_budget",       SIZE,   &writeBudget,       true,  "每次可写事件最多发送的字节数, 0 不限制" },
+        { "max_body_size",      SIZE,   &maxBodySize,       true,  "请求体上限" },
+        { "max_form_size",      SIZE,   &maxFormSize,       true,  "缓存解析的表单上限" },
+        { "max_line_size",      SIZE,   &maxLineSize,       true,  "请求行和单个头部行的上限" },
+        { "max_header_size",    SIZE,   &maxHeaderSize,     true,  "请求头总长度上限" },
+        { "max_header_count",   SIZE,   &maxHeaderCount,    true,  "请求头个数上限" },
+        { "gzip_on_the_fly",    BOOL,   &gzipOnTheFly,      true,  "没有预压缩文件时即时压缩文本" },
+        { "cold_read_min",      SIZE,   &coldReadMin,       true,  "不在页缓存中时交给读线程的最小文件大小, 0 总是 mmap" },
+        { "compress_cache_size", SIZE,  &compressCacheSize, true,  "即时压缩结果缓存的容量" },
+        { "drain_timeout_ms",   INT,    &drainTimeoutMS,    true,  "平滑升级或退出时等待连接结束的期限" },
+        { "metrics_path",       STRING, &metricsPath,       false, "Prometheus 指标的路径, 为空不提供" },
+        { "trace_sample",       INT,    &traceSample,       true,  "每 N 个请求追踪一个, 0 不追踪" },
+        { "trace_file",         STRING, &traceFile,         true,  "SIGUSR1 时写出 Chrome trace JSON 的文件" },
+    };
+}
+
+bool Config::Parse(int argc, char* argv[]) {
+    /* 先找 -c, 保证命令行中的其它参数覆盖配置文件 */
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            Usage(argv[0]);
+            exit(0);
+        }
+        if(strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--config") == 0) {
+            if(i + 1 >= argc) {
+                fprintf(stderr, "%s: missing file after %s\n", argv[0], argv[i]);
+                return false;
+            }
+            if(!Load(argv[++i])) { return false; }
+        }
+    }
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "-c" || arg == "--config") {
+            i++;
+            continue;
+        }
+        if(arg.compare(0, 2, "--") != 0 || arg.size() == 2) {
+            fprintf(stderr, "%s: unexpected argument '%s'\n", argv[0], argv[i]);
+            return false;
+        }
+        string key, value;
+        size_t eq = arg.find('=');
+        if(eq != string::npos) {
+            key = arg.substr(2, eq - 2);
+            value = arg.substr(eq + 1);
+        }
+        else if(i + 1 < argc) {
+            key = arg.substr(2);
+            value = argv[++i];
+        }
+        else {
+            fprintf(stderr, "%s: missing value for '%s'\n", argv[0], argv[i]);
+            return false;
+        }
+        /* 命令行中的键也可以用 - 连接 */
+        for(char& ch: key) {
+            if(ch == '-') { ch = '_'; }
+        }
+        if(!Set(key, value)) { return false; }
+    }
+    return true;
+}
+
+bool Config::Load(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if(!fp) {
+        fprintf(stderr, "config: can't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char line[1024];
+    int lineNo = 0;
+    bool ok = true;
+    while(fgets(line, sizeof(line), fp)) {
+        lineNo++;
+        string str = line;
+        size_t hash = str.find('#');
+        if(hash != string::npos) { str.erase(hash); }
+        str = Trim_(str);
+        if(str.empty()) { continue; }
+        size_t eq = str.find('=');
+        if(eq == string::npos) {
+            fprintf(stderr, "config: %s:%d: expected key = value\n", path, lineNo);
+            ok = false;
+            break;
+        }
+        if(!Set(Trim_(str.substr(0, eq)), Trim_(str.substr(eq + 1)))) {
+            fprintf(stderr, "config: at %s:%d\n", path, lineNo);
+            ok = false;
+            break;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+bool Config::Set(const string& key, const string& value) {
+    const Option* opt = Find_(key);
+    if(!opt) {
+        fprintf(stderr, "config: unknown key '%s'\n", key.c_str());
+        return false;
+    }
+    bool ok = true;
+    switch(opt->type) {
+    case INT: {
+        long long num;
+        ok = ParseInt_(value, &num) && num >= INT_MIN && num <= INT_MAX;
+        if(ok) { *static_cast<int*>(opt->value) = static_cast<int>(num); }
+        break;
+    }
+    case SIZE:
+        ok = ParseSize_(value, static_cast<size_t*>(opt->value));
+        break;
+    case BOOL:
+        ok = ParseBool_(value, static_cast<bool*>(opt->value));
+        break;
+    case STRING:
+        *static_cast<string*>(opt->value) = value;
+        break;
+    }
+    if(!ok) {
+        fprintf(stderr, "config: bad value '%s' for '%s'\n", value.c_str(), key.c_str());
+    }
+    return ok;
+}
+
+void Config::CopyValues(const Config& other) {
+    /* 两个对象的 options_ 顺序相同, 只复制取值, 指针仍指向自身的成员 */
+    for(size_t i = 0; i < options_.size(); i++) {
+        const Option& opt = options_[i];
+        const void* value = other.options_[i].value;
+        switch(opt.type) {
+        case INT:    *static_cast<int*>(opt.value) = *static_cast<const int*>(value); break;
+        case SIZE:   *static_cast<size_t*>(opt.value) = *static_cast<const size_t*>(value); break;
+        case BOOL:   *static_cast<bool*>(opt.value) = *static_cast<const bool*>(value); break;
+        case STRING: *static_cast<string*>(opt.value) = *static_cast<const string*>(value); break;
+        }
+    }
+}
+
+void Config::Apply() const {
+    WebServer::listenBacklog = listenBacklog;
+    WebServer::eventBatch = eventBatch;
+    WebServer::useUring = useUring;
+    WebServer::fileReadThreads = fileReadThreads;
+    WebServer::fileReadBlocks = fileReadBlocks;
+    WebServer::metricsPath = metricsPath;
+    ApplyRuntime_();
+}
+
+void Config::Reload(const Config& old, WebServer& server) const {
+    /* 两个对象的 options_ 顺序相同; 调用方先用 CopyValues 继承 old, 配置文件中删掉的键保持当前值 */
+    for(size_t i = 0; i < options_.size(); i++) {
+        const Option& opt = options_[i];
+        string value = ValueStr_(opt);
+        if(!opt.reload && value != ValueStr_(old.options_[i])) {
+            LOG_WARN("config: %s = %s takes effect after upgrade (SIGUSR2)", opt.key, value.c_str());
+        }
+    }
+    ApplyRuntime_();
+    Log::Instance()->SetLevel(logLevel);
+    server.SetTimeoutMS(timeoutMS);
+}
+
+void Config::ApplyRuntime_() const {
+    WebServer::acceptBatch = acceptBatch;
+    WebServer::busyPollUS = busyPollUS;
+    WebServer::sockBusyPollUS = sockBusyPollUS;
+    WebServer::drainTimeoutMS = drainTimeoutMS;
+    WebServer::traceFile = traceFile;
+    Tracer::sampleEvery = traceSample;
+    HttpConn::headerTimeoutMS = headerTimeoutMS;
+    HttpConn::writeBudget = writeBudget;
+    HttpRequest::maxBodySize = maxBodySize;
+    HttpRequest::maxFormSize = maxFormSize;
+    HttpRequest::maxLineSize = maxLineSize;
+    HttpRequest::maxHeaderSize = maxHeaderSize;
+    HttpRequest::maxHeaderCount = maxHeaderCount;
+    HttpResponse::gzipOnTheFly = gzipOnTheFly;
+    HttpResponse::coldReadMin = coldReadMin;
+    CompressCache::Instance()->SetCapacity(compressCacheSize);
+}
+
+void Config::Usage(const char* prog) const {
+    printf("Usage: %s [-c file] [--key=value ...]\n\n", prog);
+    for(auto& opt: options_) {
+        printf("  --%-20s %s (%s)%s\n", opt.key, opt.help, ValueStr_(opt).c_str(),
+               opt.reload ? " [SIGHUP]" : "");
+    }
+}
+
+const Config::Option* Config::Find_(const string& key) const {
+    for(auto& opt: options_) {
+        if(key == opt.key) { return &opt; }
+    }
+    return nullptr;
+}
+
+string Config::ValueStr_(const Option& opt) {
+    switch(opt.type) {
+    case INT:    return to_string(*static_cast<int*>(opt.value));
+    case SIZE:   return to_string(*static_cast<size_t*>(opt.value));
+    case BOOL:   return *static_cast<bool*>(opt.value) ? "true" : "false";
+    case STRING: return *static_cast<string*>(opt.value);
+    }
+    return "";
+}
+
+bool Config::ParseInt_(const string& str, long long* out) {
+    if(str.empty()) { return false; }
+    char* end = nullptr;
+    errno = 0;
+    long long num = strtoll(str.c_str(), &end, 10);
+    if(errno != 0 || *end != '\0') { return false; }
+    *out = num;
+    return true;
+}
+
+bool Config::ParseSize_(const string& str, size_t* out) {
+    if(str.empty() || str[0] == '-') { return false; }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long num = strtoull(str.c_str(), &end, 10);
+    if(errno != 0 || end == str.c_str()) { return false; }
+    unsigned long long unit = 1;
+    if(*end) {
+        switch(*end) {
+        case 'k': case 'K': unit = 1ULL << 10; break;
+        case 'm': case 'M': unit = 1ULL << 20; break;
+        case 'g': case 'G': unit = 1ULL << 30; break;
+        default: return false;
+        }
+        /* 允许 K/KB/KiB 这类写法 */
+        const char* rest = end + 1;
+        if(*rest && strcasecmp(rest, "b") != 0 && strcasecmp(rest, "ib") != 0) { return false; }
+    }
+    if(num > SIZE_MAX / unit) { return false; }
+    *out = static_cast<size_t>(num * unit);
+    return true;
+}
+
+bool Config::ParseBool_(const string& str, bool* out) {
+    const char* yes[] = { "true", "on", "yes", "1" };
+    const char* no[] = { "false", "off", "no", "0" };
+    for(auto word: yes) {
+        if(strcasecmp(str.c_str(), word) == 0) { *out = true; return true; }
+    }
+    for(auto word: no) {
+        if(strcasecmp(str.c_str(), word) == 0) { *out = false; return true; }
+    }
+    return false;
+}
+
+string Config::Trim_(const string& str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if(begin == string::npos) { return ""; }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
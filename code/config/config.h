@@ -0,0 +1,106 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+
+/*
+    启动配置: 默认值 <- 配置文件 <- 命令行, 后者覆盖前者
+    配置文件每行一个 key = value, # 开头为注释
+    命令行为 -c <文件> 以及 --key=value 或 --key value, 键名与配置文件相同
+    大小类的值可带 K/M/G 后缀; 布尔值接受 true/false/on/off/1/0
+    日志系统还没有初始化, 解析错误直接输出到 stderr
+    SIGHUP 时以当前取值为默认值, 重新解析同样的命令行和配置文件, 只应用标记为可重新加载的参数
+*/
+class WebServer;
+
+class Config {
+public:
+    Config();
+    Config(const Config&) = delete;     // options_ 指向自身成员, 不可复制
+    Config& operator=(const Config&) = delete;
+
+    /* 解析命令行, 其中的 -c 文件先于其余参数加载; 出错或 --help 时返回false */
+    bool Parse(int argc, char* argv[]);
+    bool Load(const char* path);
+    bool Set(const std::string& key, const std::string& value);
+    /* 以 other 的取值作为默认值, 重新加载时传入正在使用的配置 */
+    void CopyValues(const Config& other);
+
+    /* 把静态参数写入各模块, 需在创建 WebServer 之前调用 */
+    void Apply() const;
+    /* 运行中重新加载: 应用可修改的参数, 其余参数与 old 不同时提示需要平滑升级 */
+    void Reload(const Config& old, WebServer& server) const;
+    void Usage(const char* prog) const;
+
+    /* WebServer 构造参数 */
+    int port;
+    int trigMode;
+    int timeoutMS;
+    bool optLinger;
+    int sqlPort;
+    std::string sqlUser;
+    std::string sqlPwd;
+    std::string dbName;
+    int connPoolNum;
+    int threadNum;
+    bool openLog;
+    int logLevel;
+    int logQueSize;
+    std::string bundlePath;     // 为空表示不使用资源包
+    bool daemonize;
+
+    /* 各模块的静态参数 */
+    int listenBacklog;
+    int acceptBatch;
+    int eventBatch;
+    int busyPollUS;
+    int sockBusyPollUS;
+    bool useUring;
+    int fileReadThreads;
+    size_t fileReadBlocks;
+    int headerTimeoutMS;
+    size_t writeBudget;
+    size_t maxBodySize;
+    size_t maxFormSize;
+    size_t maxLineSize;
+    size_t maxHeaderSize;
+    size_t maxHeaderCount;
+    bool gzipOnTheFly;
+    size_t coldReadMin;
+    size_t compressCacheSize;
+    int drainTimeoutMS;
+    std::string metricsPath;
+    int traceSample;
+    std::string traceFile;
+
+private:
+    enum Type { INT, SIZE, BOOL, STRING };
+
+    struct Option {
+        const char* key;
+        Type type;
+        void* value;
+        bool reload;        // 可在运行中重新加载
+        const char* help;
+    };
+
+    void ApplyRuntime_() const;
+    const Option* Find_(const std::string& key) const;
+    static std::string ValueStr_(const Option& opt);
+    static bool ParseInt_(const std::string& str, long long* out);
+    static bool ParseSize_(const std::string& str, size_t* out);
+    static bool ParseBool_(const std::string& str, bool* out);
+    static std::string Trim_(const std::string& str);
+
+    std::vector<Option> options_;
+};
+
+#endif // CONFIG_H
@@ -0,0 +1,98 @@
+#include "bundle.h"
+using namespace std;
+
+const char Bundle::MAGIC[8] = { 'W', 'S', 'B', 'U', 'N', 'D', 'L', 'E' };
+
+Bundle::Bundle() : base_(nullptr), size_(0), entries_(nullptr), count_(0) {}
+
+Bundle::~Bundle() {
+    Close();
+}
+
+Bundle* Bundle::Instance() {
+    static Bundle bundle;
+    return &bundle;
+}
+
+bool Bundle::Open(const char* path) {
+    assert(path);
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(BundleHeader))) {
+        close(fd);
+        return false;
+    }
+    void* mmRet = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mmRet == MAP_FAILED) {
+        return false;
+    }
+    base_ = static_cast<char*>(mmRet);
+    size_ = st.st_size;
+    const BundleHeader* header = reinterpret_cast<const BundleHeader*>(base_);
+    entries_ = reinterpret_cast<const BundleEntry*>(base_ + sizeof(BundleHeader));
+    count_ = header->count;
+    if(!Check_()) {
+        LOG_ERROR("Bundle %s is corrupted!", path);
+        Close();
+        return false;
+    }
+    /* 预先读入内存, 避免请求时缺页 */
+    madvise(base_, size_, MADV_WILLNEED);
+    LOG_INFO("Bundle %s: %u files, %zu bytes", path, count_, size_);
+    return true;
+}
+
+void Bundle::Close() {
+    if(base_) {
+        munmap(base_, size_);
+        base_ = nullptr;
+        size_ = 0;
+        entries_ = nullptr;
+        count_ = 0;
+    }
+}
+
+bool Bundle::Check_() const {
+    const BundleHeader* header = reinterpret_cast<const BundleHeader*>(base_);
+    if(memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION) {
+        return false;
+    }
+    if(count_ > (size_ - sizeof(BundleHeader)) / sizeof(BundleEntry)) {
+        return false;
+    }
+    for(uint32_t i = 0; i < count_; i++) {
+        const BundleEntry& e = entries_[i];
+        if(uint64_t(e.pathOff) + e.pathLen > size_ || uint64_t(e.typeOff) + e.typeLen > size_
+            || uint64_t(e.etagOff) + e.etagLen > size_
+            || e.dataOff > size_ || e.dataLen > size_ - e.dataOff
+            || e.gzipOff > size_ || e.gzipLen > size_ - e.gzipOff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const BundleEntry* Bundle::Find(const string& path) const {
+    if(!base_) {
+        return nullptr;
+    }
+    /* 条目按 path 排序, 二分查找 */
+    uint32_t lo = 0, hi = count_;
+    while(lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const BundleEntry& e = entries_[mid];
+        int cmp = memcmp(base_ + e.pathOff, path.data(), min<size_t>(e.pathLen, path.size()));
+        if(cmp == 0) {
+            if(e.pathLen == path.size()) { return &e; }
+            cmp = e.pathLen < path.size() ? -1 : 1;
+        }
+        if(cmp < 0) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return nullptr;
+}
@@ -0,0 +1,66 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string>
+#include <stdint.h>
+#include <fcntl.h>       // open
+#include <unistd.h>      // close
+#include <sys/stat.h>    // fstat
+#include <sys/mman.h>    // mmap, munmap
+
+#include "../log/log.h"
+
+/*
+    静态资源包: 构建时由 bin/packres 把 resources 目录打包成一个文件
+    启动时整体映射到内存, 请求时二分查找, 不再访问磁盘
+
+    文件布局:
+        BundleHeader
+        BundleEntry[count]      按 path 字节序排序
+        字符串区                 path / Content-type / ETag
+        数据区                   原始内容, 以及可选的 gzip 版本
+*/
+struct BundleHeader {
+    char magic[8];          // "WSBUNDLE"
+    uint32_t version;
+    uint32_t count;
+};
+
+struct BundleEntry {
+    uint32_t pathOff, pathLen;
+    uint32_t typeOff, typeLen;
+    uint32_t etagOff, etagLen;
+    uint64_t dataOff, dataLen;
+    uint64_t gzipOff, gzipLen;     // gzipLen 为0表示没有压缩版本
+    int64_t mtime;
+};
+
+class Bundle {
+public:
+    static Bundle* Instance();
+
+    bool Open(const char* path);
+    void Close();
+    bool IsOpen() const { return base_ != nullptr; }
+
+    const BundleEntry* Find(const std::string& path) const;
+
+    const char* Data(uint64_t off) const { return base_ + off; }
+    std::string Str(uint32_t off, uint32_t len) const { return std::string(base_ + off, len); }
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
+private:
+    Bundle();
+    ~Bundle();
+
+    bool Check_() const;
+
+    char* base_;
+    size_t size_;
+    const BundleEntry* entries_;
+    uint32_t count_;
+};
+
+#endif // BUNDLE_H
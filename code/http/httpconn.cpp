@@ -4,11 +4,25 @@ using namespace std;
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+std::atomic<int> HttpConn::headerTimeoutMS(10000);
+std::atomic<size_t> HttpConn::writeBudget(256 * 1024);
+std::atomic<bool> HttpConn::draining(false);
+std::function<void(HttpConn*)> HttpConn::onFileReady;
 
 HttpConn::HttpConn() { 
     fd_ = -1;
+    gen_ = 0;
     addr_ = { 0 };
     isClose_ = true;
+    headerStart_ = 0;
+    lastActive_ = 0;
+    owner_ = 1;
+    idle_ = false;
+    parseNs_ = 0;
+    writeStart_ = 0;
+    writePending_ = false;
+    traceId_ = 0;
+    traceStart_ = 0;
 };
 
 HttpConn::~HttpConn() { 
@@ -20,16 +34,32 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     userCount++;
     addr_ = addr;
     fd_ = fd;
+    gen_++;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    /* 复用的连接对象可能停在上一个客户端的半个请求上 */
+    request_.Init();
+    /* 从接受连接起就按请求头期限计时, 一直不发送数据的客户端同样会被关闭 */
+    headerStart_ = Metrics::Now();
+    lastActive_ = headerStart_;
+    /* 新连接还没有收到任何数据, 由主线程持有, 算作空闲 */
+    owner_.store((owner_.load(std::memory_order_relaxed) | 1) + 2, std::memory_order_relaxed);
+    idle_ = true;
+    parseNs_ = 0;
+    writePending_ = false;
+    traceId_ = 0;
     isClose_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
     response_.UnmapFile();
-    if(isClose_ == false){
-        isClose_ = true; 
+    if(fileRead_) {
+        /* 正在进行的读取完成后不再通知这个连接 */
+        fileRead_->Cancel();
+        fileRead_ = nullptr;
+    }
+    if(!isClose_.exchange(true)) {
         userCount--;
         close(fd_);
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
@@ -53,24 +83,81 @@ int HttpConn::GetPort() const {
 }
 
 ssize_t HttpConn::read(int* saveErrno) {
+    TraceSpan span("read");
     ssize_t len = -1;
     do {
         len = readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
-    } while (isET);
+        Metrics::Add(Metrics::BYTES_READ, len);
+    } while (isET && readBuff_.ReadableBytes() < READ_BATCH);
+    UpdateHeaderClock_();
     return len;
 }
 
+void HttpConn::SampleTrace() {
+    if(traceId_ == 0 && request_.BetweenRequests()) {
+        traceId_ = Tracer::Instance()->Sample();
+        traceStart_ = traceId_ ? Metrics::Now() : 0;
+    }
+}
+
+void HttpConn::EndTrace_() {
+    /* 从第一个读事件到最后一个字节写出, 整个请求记为一个 span, 之后的请求重新采样 */
+    if(traceId_) {
+        Tracer::Record(traceId_, "request", traceStart_, Metrics::Now());
+        traceId_ = 0;
+    }
+}
+
+void HttpConn::UpdateHeaderClock_() {
+    if(!request_.AwaitingHeader()) {
+        headerStart_ = 0;
+    }
+    else if(headerStart_ == 0 && readBuff_.ReadableBytes() > 0) {
+        /* 流水线中下一个请求的头部已经到达 */
+        headerStart_ = Metrics::Now();
+    }
+}
+
+int HttpConn::TimeoutMS(int idleMS) const {
+    uint64_t now = Metrics::Now();
+    /* idleMS <= 0 表示不限制空闲时间 */
+    int64_t left = INT_MAX;
+    if(idleMS > 0) {
+        left = idleMS - static_cast<int64_t>((now - lastActive_) / 1000000);
+    }
+    int limit = headerTimeoutMS;
+    if(limit > 0) {
+        uint64_t start = headerStart_;
+        if(start) {
+            int64_t used = now > start ? static_cast<int64_t>((now - start) / 1000000) : 0;
+            left = std::min<int64_t>(left, limit - used);
+        }
+        else {
+            left = std::min<int64_t>(left, limit);
+        }
+    }
+    return static_cast<int>(std::max<int64_t>(left, INT_MIN));
+}
+
 ssize_t HttpConn::write(int* saveErrno) {
+    TraceSpan span("write");
     ssize_t len = -1;
+    size_t written = 0;
     do {
+        if(ToWriteBytes() == 0 && !NextChunk_(saveErrno)) {
+            /* 冷文件的下一块还没读好(EINPROGRESS)或读取出错 */
+            if(*saveErrno) { len = -1; }
+            break;
+        }
         len = writev(fd_, iov_, iovCnt_);
         if(len <= 0) {
             *saveErrno = errno;
             break;
         }
+        written += len;
         if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
         else if(static_cast<size_t>(len) > iov_[0].iov_len) {
             iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
@@ -85,26 +172,119 @@ ssize_t HttpConn::write(int* saveErrno) {
             iov_[0].iov_len -= len; 
             writeBuff_.Retrieve(len);
         }
+        /* 本轮额度用完就让出线程, 由 OnWrite_ 重新注册 EPOLLOUT 排到其他连接之后 */
+        if(writeBudget > 0 && written >= writeBudget) { break; }
     } while(isET || ToWriteBytes() > 10240);
+    Metrics::Add(Metrics::BYTES_WRITTEN, written);
+    /* EINPROGRESS 时读线程随时可能重新注册可写事件, 不能再访问连接 */
+    if(*saveErrno != EINPROGRESS && writePending_ && IsWriteDone()) {
+        writePending_ = false;
+        Metrics::Record(Metrics::WRITE, Metrics::Now() - writeStart_);
+        EndTrace_();
+    }
     return len;
 }
 
+bool HttpConn::NextChunk_(int* saveErrno) {
+    if(fileRead_) {
+        return NextBlock_(saveErrno);
+    }
+    /* 上一块已经发完, 才向生成器要下一块 */
+    if(response_.StreamDone()) {
+        return false;
+    }
+    writeBuff_.RetrieveAll();
+    response_.NextChunk(writeBuff_);
+    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
+    iov_[0].iov_len = writeBuff_.ReadableBytes();
+    iov_[1].iov_len = 0;
+    iovCnt_ = 1;
+    return true;
+}
+
+bool HttpConn::NextBlock_(int* saveErrno) {
+    /* 上一块已经发完, 让读线程读下一块; 文件读完即传输结束 */
+    if(!fileRead_->Next()) {
+        fileRead_ = nullptr;
+        return false;
+    }
+    /* 这一块还没读好: 登记回调后不能再访问连接, 读完由 onFileReady 重新注册可写事件 */
+    ssize_t len = fileRead_->Take([this] { onFileReady(this); });
+    if(len <= 0) {
+        *saveErrno = len == 0 ? EINPROGRESS : -len;
+        return false;
+    }
+    iov_[0].iov_len = 0;
+    iov_[1].iov_base = const_cast<char*>(fileRead_->Block());
+    iov_[1].iov_len = len;
+    iovCnt_ = 2;
+    return true;
+}
+
 bool HttpConn::process() {
-    request_.Init();
     if(readBuff_.ReadableBytes() <= 0) {
+        idle_ = request_.BetweenRequests();
+        if(idle_) {
+            traceId_ = 0;
+            /* 长连接的响应写完, 开始等待下一个请求的头部 */
+            if(headerStart_ == 0) { headerStart_ = Metrics::Now(); }
+        }
+        return false;
+    }
+    uint64_t start = Metrics::Now();
+    HttpRequest::HTTP_CODE ret = request_.parse(readBuff_);
+    uint64_t parsed = Metrics::Now();
+    parseNs_ += parsed - start;
+    Tracer::Record("parse", start, parsed);
+    if(ret != HttpRequest::NO_REQUEST) {
+        /* 流水线中剩下的字节属于下一个请求, 重新计时 */
+        headerStart_ = 0;
+        Metrics::Record(Metrics::PARSE, parseNs_);
+        parseNs_ = 0;
+    }
+    UpdateHeaderClock_();
+    if(ret == HttpRequest::NO_REQUEST) {
+        /* 请求不完整, 继续读 */
+        if(request_.TakeExpectContinue()) {
+            const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            send(fd_, cont, sizeof(cont) - 1, MSG_NOSIGNAL);
+        }
         return false;
     }
-    else if(request_.parse(readBuff_)) {
+    else if(ret == HttpRequest::GET_REQUEST) {
         LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
-    } else {
+        response_.Init(srcDir, request_.path(), request_.IsKeepAlive() && !draining, 200);
+        response_.SetRange(request_.GetHeader("Range"), request_.GetHeader("If-Range"));
+        response_.SetValidators(request_.GetHeader("If-None-Match"), request_.GetHeader("If-Modified-Since"));
+        response_.SetAcceptEncoding(request_.GetHeader("Accept-Encoding"));
+        response_.SetChunked(request_.version() == "1.1");
+        Router::Instance()->Dispatch(request_, response_);
+    }
+    else if(ret == HttpRequest::PAYLOAD_TOO_LARGE) {
+        response_.Init(srcDir, request_.path(), false, 413);
+    }
+    else if(ret == HttpRequest::URI_TOO_LONG) {
+        response_.Init(srcDir, request_.path(), false, 414);
+    }
+    else if(ret == HttpRequest::HEADER_TOO_LARGE) {
+        response_.Init(srcDir, request_.path(), false, 431);
+    }
+    else if(ret == HttpRequest::INTERNAL_ERROR) {
+        response_.Init(srcDir, request_.path(), false, 500);
+    }
+    else {
         response_.Init(srcDir, request_.path(), false, 400);
     }
 
     response_.MakeResponse(writeBuff_);
+    if(response_.IsStreaming()) {
+        /* 第一块和响应头一起发出, 减少首字节时间 */
+        response_.NextChunk(writeBuff_);
+    }
     /* 响应头 */
     iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
     iov_[0].iov_len = writeBuff_.ReadableBytes();
+    iov_[1].iov_len = 0;
     iovCnt_ = 1;
 
     /* 文件 */
@@ -113,6 +293,13 @@ bool HttpConn::process() {
         iov_[1].iov_len = response_.FileLen();
         iovCnt_ = 2;
     }
+    /* 冷文件: 读线程已经开始读第一块, 响应头发完后再按块发送 */
+    fileRead_ = response_.TakeFileRead();
+    Metrics::AddStatus(response_.Code());
+    writeStart_ = Metrics::Now();
+    writePending_ = true;
+    Metrics::Record(Metrics::BUILD, writeStart_ - parsed);
+    Tracer::Record("build", parsed, writeStart_);
     LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
     return true;
 }
@@ -5,13 +5,18 @@
 #include <sys/uio.h>     // readv/writev
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
+#include <limits.h>
 #include <errno.h>      
+#include <chrono>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAll.h"
 #include "../buffer/buffer.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "router.h"
+#include "../metrics/metrics.h"
+#include "../metrics/trace.h"
 
 class HttpConn {
 public:
@@ -29,6 +34,11 @@ public:
 
     int GetFd() const;
 
+    /* 每次 init 加一, 用来识别 fd 复用之前留下的过期事件 */
+    uint32_t GetGen() const {
+        return gen_;
+    }
+
     int GetPort() const;
 
     const char* GetIP() const;
@@ -41,20 +51,89 @@ public:
         return iov_[0].iov_len + iov_[1].iov_len; 
     }
 
+    /* 流式响应要等生成器结束, 冷文件要等最后一块读完发完才算写完 */
+    bool IsWriteDone() const {
+        return iov_[0].iov_len + iov_[1].iov_len == 0 && response_.StreamDone() && !fileRead_;
+    }
+
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return response_.IsKeepAlive();
+    }
+
+    /*
+        到下一次检查的毫秒数, <= 0 表示已经超时, 只在主线程调用
+        等待请求头时(包括刚建立的连接和长连接上的下一个请求)不超过请求头的剩余期限,
+        慢速发送头部或一直不发送都不能续期; 处理请求期间按请求头期限的间隔重新检查
+    */
+    int TimeoutMS(int idleMS) const;
+
+    /* 主线程每次分发读写事件时调用, 空闲超时从这里开始计算 */
+    void Touch() {
+        lastActive_ = Metrics::Now();
+    }
+
+    /*
+        空闲的长连接: 已交还主线程, 在等待下一个请求且没有未处理的数据, 排空时可以直接关闭
+        只在主线程调用; 工作线程交还之前不算空闲, 避免关闭后工作线程再对 fd 调用 ModFd
+    */
+    bool IsIdle() const {
+        return IsHandedBack() && idle_;
     }
 
+    /* 工作线程已经交还(或还没有交出), 主线程可以释放连接的状态; 只在主线程调用 */
+    bool IsHandedBack() const {
+        return owner_.load(std::memory_order_acquire) & 1;
+    }
+
+    /* 主线程把连接交给工作线程前调用, 空闲标记由工作线程在 process 中重新设置 */
+    void SetBusy() {
+        idle_ = false;
+        owner_.store((owner_.load(std::memory_order_relaxed) | 1) + 1, std::memory_order_relaxed);
+    }
+
+    /* 工作线程重新注册事件之前取得交接序号, 注册之后用它交还; 期间已被再次分发时什么也不做 */
+    uint32_t OwnerSeq() const {
+        return owner_.load(std::memory_order_relaxed);
+    }
+    void HandBack(uint32_t seq) {
+        owner_.compare_exchange_strong(seq, seq + 1, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    bool IsClosed() const {
+        return isClose_;
+    }
+
+    /* 当前请求的追踪 id, 0 表示没有采样 */
+    uint64_t TraceId() const {
+        return traceId_;
+    }
+
+    /* 主线程分发读事件前调用: 连接在等待新请求时决定这个请求是否采样 */
+    void SampleTrace();
+
     static bool isET;
+    static std::atomic<int> headerTimeoutMS;    // 从建立连接或上一个响应写完起, 读完下一个请求头的期限
+    static std::atomic<size_t> writeBudget;     // 每次可写事件最多发送的字节数, 0 表示写到 EAGAIN 为止
+    static std::atomic<bool> draining;          // 正在排空连接: 响应一律 Connection: close
     static const char* srcDir;
     static std::atomic<int> userCount;
+    /* 冷文件的下一块在读线程中读好后调用, write 返回 EINPROGRESS 后由它重新注册 EPOLLOUT */
+    static std::function<void(HttpConn*)> onFileReady;
     
 private:
-   
+    bool NextChunk_(int* saveErrno);
+    bool NextBlock_(int* saveErrno);
+    void UpdateHeaderClock_();
+    void EndTrace_();
+
+    /* ET模式下单次最多读入的字节数, 大请求体分批解析, 读缓冲区不会随上传增长 */
+    static const size_t READ_BATCH = 64 * 1024;
+
     int fd_;
+    std::atomic<uint32_t> gen_;
     struct  sockaddr_in addr_;
 
-    bool isClose_;
+    std::atomic<bool> isClose_;
     
     int iovCnt_;
     struct iovec iov_[2];
@@ -64,6 +143,19 @@ private:
 
     HttpRequest request_;
     HttpResponse response_;
+    std::shared_ptr<FileRead> fileRead_;
+
+    /* 开始等待请求头的时刻(单调时钟, 纳秒), 0 表示不在等待; 工作线程写, 主线程读 */
+    std::atomic<uint64_t> headerStart_;
+    uint64_t lastActive_;       // 只在主线程读写
+    /* 交接序号: 偶数表示在工作线程中, 奇数表示已交还主线程; 只增不减, 复用的连接对象不会误交还 */
+    std::atomic<uint32_t> owner_;
+    bool idle_;                 // 工作线程在交还前写入, 主线程在交还后读取
+    uint64_t parseNs_;          // 当前请求累计的解析时间, 请求可能分多次读入
+    uint64_t writeStart_;       // 响应就绪的时刻
+    bool writePending_;         // 响应还没有写完, 写完时记录写阶段的耗时
+    uint64_t traceId_;
+    uint64_t traceStart_;       // 采样请求的第一个读事件被分发的时刻
 };
 
 
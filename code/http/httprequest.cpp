@@ -1,262 +1,511 @@
 #include "httprequest.h"
+#include "router.h"
+#include "httpscan.h"
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML{
-            "/index", "/register", "/login",
-             "/welcome", "/video", "/picture", };
-
-const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
-            {"/register.html", 0}, {"/login.html", 1},  };
+std::atomic<size_t> HttpRequest::maxBodySize(64 * 1024 * 1024);
+std::atomic<size_t> HttpRequest::maxFormSize(1024 * 1024);
+std::atomic<size_t> HttpRequest::maxLineSize(8 * 1024);
+std::atomic<size_t> HttpRequest::maxHeaderSize(32 * 1024);
+std::atomic<size_t> HttpRequest::maxHeaderCount(100);
 
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    /* clear 保留容量 */
+    method_.clear();
+    path_.clear();
+    version_.clear();
+    body_.clear();
+    arena_.clear();
     state_ = REQUEST_LINE;
+    bodyState_ = BODY_DATA;
+    bodyRemain_ = bodyLen_ = 0;
+    bodyLimit_ = maxBodySize;
+    lineScan_ = 0;
+    headerBytes_ = 0;
+    chunked_ = false;
+    expectContinue_ = false;
+    bodyHandler_ = nullptr;
     header_.clear();
     post_.clear();
+    query_.clear();
 }
 
 bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+    const char* conn = HeaderValue("Connection");
+    return conn && strcasecmp(conn, "keep-alive") == 0 && version_ == "1.1";
+}
+
+bool HttpRequest::TakeExpectContinue() {
+    /* 客户端在等 100 Continue 才发送请求体, 只回应一次 */
+    if(expectContinue_ && state_ == BODY && bodyLen_ == 0) {
+        expectContinue_ = false;
+        return true;
     }
     return false;
 }
 
-bool HttpRequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";
-    if(buff.ReadableBytes() <= 0) {
-        return false;
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
+    if(state_ == FINISH) {
+        Init();
     }
     while(buff.ReadableBytes() && state_ != FINISH) {
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buff.Peek(), lineEnd);
+        HTTP_CODE ret = NO_REQUEST;
+        if(state_ == BODY && bodyState_ == BODY_DATA) {
+            ret = ParseBody_(buff);
+            if(ret != NO_REQUEST) { return ret; }
+            continue;
+        }
+        /* 上次已经扫描过且没有行尾的部分不再重复扫描, 留1字节给跨两次读取的 "\r\n" */
+        const char* end = buff.BeginWriteConst();
+        const char* lineEnd = FindCRLF(buff.Peek() + lineScan_, end);
+        if(lineEnd == end) {
+            /* 行不完整, 等待更多数据; 超长的行不再继续缓存 */
+            if(buff.ReadableBytes() > maxLineSize) {
+                return LineTooLong_();
+            }
+            lineScan_ = buff.ReadableBytes() - 1;
+            break;
+        }
+        lineScan_ = 0;
+        size_t lineLen = lineEnd - buff.Peek();
+        if(lineLen > maxLineSize) {
+            return LineTooLong_();
+        }
+        if(state_ != BODY || bodyState_ == CHUNK_TRAILER) {
+            headerBytes_ += lineLen + 2;
+            if(headerBytes_ > maxHeaderSize) {
+                LOG_WARN("Header too large");
+                return HEADER_TOO_LARGE;
+            }
+        }
+        /* 行直接在读缓冲区中解析, 需要保留的部分拷进 arena_ */
+        const char* line = buff.Peek();
         switch(state_)
         {
         case REQUEST_LINE:
-            if(!ParseRequestLine_(line)) {
-                return false;
+            if(!ParseRequestLine_(line, lineEnd)) {
+                return BAD_REQUEST;
             }
-            ParsePath_();
             break;    
         case HEADERS:
-            ParseHeader_(line);
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
-            }
+            ret = ParseHeader_(line, lineEnd);
             break;
         case BODY:
-            ParseBody_(line);
+            ret = ParseChunkLine_(line, lineEnd);
             break;
         default:
             break;
         }
-        if(lineEnd == buff.BeginWrite()) { break; }
         buff.RetrieveUntil(lineEnd + 2);
+        if(ret != NO_REQUEST) { return ret; }
+    }
+    if(state_ != FINISH) {
+        return NO_REQUEST;
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    return GET_REQUEST;
 }
 
-void HttpRequest::ParsePath_() {
-    if(path_ == "/") {
-        path_ = "/index.html"; 
+HttpRequest::HTTP_CODE HttpRequest::LineTooLong_() const {
+    LOG_WARN("Line too long");
+    if(state_ == REQUEST_LINE) {
+        return URI_TOO_LONG;
     }
-    else {
-        for(auto &item: DEFAULT_HTML) {
-            if(item == path_) {
-                path_ += ".html";
-                break;
-            }
-        }
+    if(state_ == HEADERS || bodyState_ == CHUNK_TRAILER) {
+        return HEADER_TOO_LARGE;
     }
+    return BAD_REQUEST;
 }
 
-bool HttpRequest::ParseRequestLine_(const string& line) {
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS;
+bool HttpRequest::ParseRequestLine_(const char* begin, const char* end) {
+    /* METHOD SP request-target SP HTTP/version */
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1)) : nullptr;
+    if(!sp1 || !sp2 || sp1 == begin || sp2 == sp1 + 1
+        || end - sp2 - 1 < 5 || memcmp(sp2 + 1, "HTTP/", 5) != 0
+        || memchr(sp2 + 1, ' ', end - sp2 - 1)) {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    method_.assign(begin, sp1);
+    version_.assign(sp2 + 6, end);
+    if(!ParseTarget_(sp1 + 1, sp2)) {
+        LOG_ERROR("Request target Error");
+        return false;
+    }
+    state_ = HEADERS;
+    return true;
+}
+
+bool HttpRequest::ParseTarget_(const char* begin, const char* end) {
+    /* absolute-form: 去掉 scheme://authority, 只保留路径部分 */
+    if(end - begin >= 7 && (strncasecmp(begin, "http://", 7) == 0
+                            || (end - begin >= 8 && strncasecmp(begin, "https://", 8) == 0))) {
+        begin = FindAnyOf(begin + 7 + (begin[4] != ':'), end, "/?#", 3);
+    }
+    /* path [? query] [# fragment] */
+    const char* pathEnd = FindAnyOf(begin, end, "?#", 2);
+    if(pathEnd != end && *pathEnd == '?') {
+        const char* queryEnd = FindAnyOf(pathEnd + 1, end, "#", 1);
+        ParseUrlencoded_(pathEnd + 1, queryEnd - pathEnd - 1, query_);
+    }
+    if(begin == pathEnd) {
+        path_ = "/";
         return true;
     }
-    LOG_ERROR("RequestLine Error");
-    return false;
+    if(*begin != '/') {
+        return false;
+    }
+    /* 先解码再规范化, %2e%2e 之类的写法同样会被折叠 */
+    path_.resize(pathEnd - begin);
+    path_.resize(UrlDecode(begin, pathEnd - begin, &path_[0], false));
+    if(memchr(path_.data(), '\0', path_.size())) {
+        return false;
+    }
+    NormalizePath_(path_);
+    return true;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2];
+void HttpRequest::NormalizePath_(string& path) {
+    /* 合并重复的 '/', 去掉 "." 段, ".." 回退一段且不会越过根目录, 结果总是以 '/' 开头 */
+    char* buf = &path[0];
+    size_t n = path.size();
+    size_t out = 0, i = 0;
+    bool trailing = n > 0 && buf[n - 1] == '/';
+    bool dotEnd = false;    // 最后一段是 "." 或 "..", 结果是目录
+    while(i < n) {
+        while(i < n && buf[i] == '/') { i++; }
+        size_t seg = i;
+        while(i < n && buf[i] != '/') { i++; }
+        size_t segLen = i - seg;
+        if(segLen == 0) {
+            break;
+        }
+        if(segLen == 1 && buf[seg] == '.') {
+            dotEnd = true;
+            continue;
+        }
+        if(segLen == 2 && buf[seg] == '.' && buf[seg + 1] == '.') {
+            while(out > 0 && buf[--out] != '/') {}
+            dotEnd = true;
+            continue;
+        }
+        /* 写指针不会超过读指针, 原地移动即可 */
+        buf[out++] = '/';
+        memmove(buf + out, buf + seg, segLen);
+        out += segLen;
+        dotEnd = false;
     }
-    else {
-        state_ = BODY;
+    if(out == 0 || trailing || dotEnd) {
+        buf[out++] = '/';
     }
+    path.resize(out);
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;
-    ParsePost_();
-    state_ = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+HttpRequest::HTTP_CODE HttpRequest::ParseHeader_(const char* begin, const char* end) {
+    if(begin == end) {
+        return ParseHeadersEnd_();
+    }
+    if(header_.size() >= maxHeaderCount) {
+        LOG_WARN("Too many headers");
+        return HEADER_TOO_LARGE;
+    }
+    /* field-name ":" OWS field-value OWS, 名字和冒号之间不允许有空白 */
+    const char* colon = FindAnyOf(begin, end, ":", 1);
+    if(colon == end || colon == begin || colon[-1] == ' ' || colon[-1] == '\t') {
+        LOG_ERROR("Header Error");
+        return BAD_REQUEST;
+    }
+    const char* value = colon + 1;
+    const char* valueEnd = end;
+    while(value < valueEnd && (*value == ' ' || *value == '\t')) { value++; }
+    while(valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) { valueEnd--; }
+
+    Field field;
+    field.keyLen = colon - begin;
+    field.key = Intern_(begin, field.keyLen);
+    field.valueLen = valueEnd - value;
+    field.value = Intern_(value, field.valueLen);
+    header_.push_back(field);
+    return NO_REQUEST;
 }
 
-int HttpRequest::ConverHex(char ch) {
-    if(ch >= 'A' && ch <= 'F') return ch -'A' + 10;
-    if(ch >= 'a' && ch <= 'f') return ch -'a' + 10;
-    return ch;
+uint32_t HttpRequest::Intern_(const char* str, size_t len) {
+    uint32_t off = arena_.size();
+    arena_.insert(arena_.end(), str, str + len);
+    arena_.push_back('\0');
+    return off;
 }
 
-void HttpRequest::ParsePost_() {
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
-        ParseFromUrlencoded_();
-        if(DEFAULT_HTML_TAG.count(path_)) {
-            int tag = DEFAULT_HTML_TAG.find(path_)->second;
-            LOG_DEBUG("Tag:%d", tag);
-            if(tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
-                    path_ = "/error.html";
-                }
-            }
+HttpRequest::HTTP_CODE HttpRequest::ParseHeadersEnd_() {
+    /* 空行: 头部结束, 根据 Transfer-Encoding / Content-Length 决定请求体的读取方式 */
+    const char* te = HeaderValue("Transfer-Encoding");
+    const char* cl = HeaderValue("Content-Length");
+    bodyLimit_ = maxBodySize;
+    if(te) {
+        if(strcasecmp(te, "chunked") != 0) {
+            return BAD_REQUEST;
         }
-    }   
+        chunked_ = true;
+        bodyState_ = CHUNK_SIZE;
+    }
+    else if(cl) {
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long len = strtoull(cl, &end, 10);
+        if(!isdigit(cl[0]) || *end != '\0' || errno == ERANGE) {
+            return BAD_REQUEST;
+        }
+        if(len > bodyLimit_) {
+            LOG_WARN("Content-Length %llu too large", len);
+            return PAYLOAD_TOO_LARGE;
+        }
+        if(len == 0) {
+            FinishBody_();
+            return NO_REQUEST;
+        }
+        bodyState_ = BODY_DATA;
+        bodyRemain_ = len;
+    }
+    else {
+        state_ = FINISH;
+        return NO_REQUEST;
+    }
+    state_ = BODY;
+    const char* expect = HeaderValue("Expect");
+    expectContinue_ = expect && strcasecmp(expect, "100-continue") == 0;
+    bodyHandler_ = Router::Instance()->BodyHandlerFor(*this);
+    return NO_REQUEST;
 }
 
-void HttpRequest::ParseFromUrlencoded_() {
-    if(body_.size() == 0) { return; }
+HttpRequest::HTTP_CODE HttpRequest::ParseBody_(Buffer& buff) {
+    size_t len = min(bodyRemain_, buff.ReadableBytes());
+    HTTP_CODE ret = OnBodyData_(buff.Peek(), len);
+    if(ret != NO_REQUEST) { return ret; }
+    buff.Retrieve(len);
+    bodyRemain_ -= len;
+    if(bodyRemain_ == 0) {
+        if(chunked_) {
+            bodyState_ = CHUNK_END;
+        } else {
+            FinishBody_();
+        }
+    }
+    return NO_REQUEST;
+}
 
-    string key, value;
-    int num = 0;
-    int n = body_.size();
-    int i = 0, j = 0;
+HttpRequest::HTTP_CODE HttpRequest::ParseChunkLine_(const char* begin, const char* lineEnd) {
+    bool empty = begin == lineEnd;
+    switch(bodyState_)
+    {
+    case CHUNK_SIZE: {
+        /* chunk-size [; chunk-ext], 行尾的 "\r\n" 还在缓冲区中, strtoull 会停在 '\r' 上 */
+        if(empty || !isxdigit(*begin)) {
+            return BAD_REQUEST;
+        }
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long len = strtoull(begin, &end, 16);
+        if(errno == ERANGE
+            || (end != lineEnd && *end != ';' && *end != ' ' && *end != '\t')) {
+            return BAD_REQUEST;
+        }
+        if(len > bodyLimit_ - bodyLen_) {
+            return PAYLOAD_TOO_LARGE;
+        }
+        if(len == 0) {
+            bodyState_ = CHUNK_TRAILER;
+        } else {
+            bodyRemain_ = len;
+            bodyState_ = BODY_DATA;
+        }
+        break;
+    }
+    case CHUNK_END:
+        if(!empty) { return BAD_REQUEST; }
+        bodyState_ = CHUNK_SIZE;
+        break;
+    case CHUNK_TRAILER:
+        /* 忽略 trailer, 空行表示请求体结束 */
+        if(empty) { FinishBody_(); }
+        break;
+    default:
+        break;
+    }
+    return NO_REQUEST;
+}
 
-    for(; i < n; i++) {
-        char ch = body_[i];
-        switch (ch) {
-        case '=':
-            key = body_.substr(j, i - j);
-            j = i + 1;
-            break;
-        case '+':
-            body_[i] = ' ';
-            break;
-        case '%':
-            num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-            body_[i + 2] = num % 10 + '0';
-            body_[i + 1] = num / 10 + '0';
-            i += 2;
-            break;
-        case '&':
-            value = body_.substr(j, i - j);
-            j = i + 1;
-            post_[key] = value;
-            LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
-            break;
-        default:
-            break;
+HttpRequest::HTTP_CODE HttpRequest::OnBodyData_(const char* data, size_t len) {
+    if(len > bodyLimit_ - bodyLen_) {
+        return PAYLOAD_TOO_LARGE;
+    }
+    bodyLen_ += len;
+    if(bodyHandler_) {
+        if(!bodyHandler_(data, len)) {
+            LOG_WARN("Body handler rejected [%s]", path_.c_str());
+            return INTERNAL_ERROR;
         }
+        return NO_REQUEST;
     }
-    assert(j <= i);
-    if(post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+    if(body_.size() + len > maxFormSize) {
+        return PAYLOAD_TOO_LARGE;
     }
+    body_.append(data, len);
+    return NO_REQUEST;
 }
 
-bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin) {
-    if(name == "" || pwd == "") { return false; }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConnRAII(&sql,  SqlConnPool::Instance());
-    assert(sql);
-    
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = { 0 };
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { flag = true; }
-    /* 查询用户及密码 */
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
+void HttpRequest::FinishBody_() {
+    if(!bodyHandler_) {
+        ParsePost_();
+        LOG_DEBUG("Body:%s, len:%d", body_.c_str(), body_.size());
+    }
+    state_ = FINISH;
+}
 
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
+int HttpRequest::ConverHex(char ch) {
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+size_t HttpRequest::UrlDecode(const char* src, size_t len, char* dst, bool plusAsSpace) {
+    const char* end = src + len;
+    char* out = dst;
+    while(src < end) {
+        /* 普通字符整段拷贝, 只在 '%' / '+' 处逐个处理 */
+        const char* special = FindAnyOf(src, end, "%+", plusAsSpace ? 2 : 1);
+        memmove(out, src, special - src);
+        out += special - src;
+        src = special;
+        if(src == end) {
+            break;
+        }
+        int hi, lo;
+        if(*src == '+') {
+            *out++ = ' ';
+            src++;
+        }
+        else if(end - src >= 3 && (hi = ConverHex(src[1])) >= 0 && (lo = ConverHex(src[2])) >= 0) {
+            *out++ = static_cast<char>(hi << 4 | lo);
+            src += 3;
+        }
+        else {
+            *out++ = *src++;
+        }
     }
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res);
-    fields = mysql_fetch_fields(res);
+    return out - dst;
+}
 
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
+void HttpRequest::ParsePost_() {
+    /* 只负责解析表单, 由路由层在解析完成后决定响应 */
+    const char* type = HeaderValue("Content-Type");
+    if(method_ == "POST" && type && strcmp(type, "application/x-www-form-urlencoded") == 0) {
+        ParseUrlencoded_(body_.data(), body_.size(), post_);
+    }   
+}
+
+void HttpRequest::ParseUrlencoded_(const char* data, size_t len, vector<Field>& fields) {
+    /* key=value&key=value, 一遍解码直接写进 arena_, 不再为每个字段构造 string */
+    const char* end = data + len;
+    while(data < end) {
+        const char* pairEnd = FindAnyOf(data, end, "&", 1);
+        if(pairEnd != data) {
+            const char* eq = FindAnyOf(data, pairEnd, "=", 1);
+            const char* value = eq == pairEnd ? pairEnd : eq + 1;
+            Field field;
+            field.key = InternDecoded_(data, eq - data, &field.keyLen);
+            field.value = InternDecoded_(value, pairEnd - value, &field.valueLen);
+            fields.push_back(field);
+            LOG_DEBUG("%s = %s", &arena_[field.key], &arena_[field.value]);
         }
+        if(pairEnd == end) {
+            break;
+        }
+        data = pairEnd + 1;
     }
-    mysql_free_result(res);
+}
 
-    /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
+uint32_t HttpRequest::InternDecoded_(const char* str, size_t len, uint32_t* decodedLen) {
+    uint32_t off = arena_.size();
+    arena_.resize(off + len + 1);
+    *decodedLen = UrlDecode(str, len, &arena_[off], true);
+    arena_.resize(off + *decodedLen);
+    arena_.push_back('\0');
+    return off;
+}
+
+const HttpRequest::Field* HttpRequest::FindField_(const vector<Field>& fields, const char* key,
+                                                  size_t keyLen, bool ignoreCase) const {
+    /* 字段一般只有十几个, 顺序比较即可; 重复出现时以最后一个为准 */
+    for(auto it = fields.rbegin(); it != fields.rend(); ++it) {
+        if(it->keyLen != keyLen) {
+            continue;
+        }
+        const char* name = &arena_[it->key];
+        if(ignoreCase ? strncasecmp(name, key, keyLen) == 0 : memcmp(name, key, keyLen) == 0) {
+            return &*it;
         }
-        flag = true;
     }
-    SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG( "UserVerify success!!");
-    return flag;
+    return nullptr;
 }
 
-std::string HttpRequest::path() const{
+const std::string& HttpRequest::path() const{
     return path_;
 }
 
 std::string& HttpRequest::path(){
     return path_;
 }
-std::string HttpRequest::method() const {
+const std::string& HttpRequest::method() const {
     return method_;
 }
 
-std::string HttpRequest::version() const {
+const std::string& HttpRequest::version() const {
     return version_;
 }
 
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
+    const Field* field = FindField_(post_, key.data(), key.size(), false);
+    if(field) {
+        return std::string(&arena_[field->value], field->valueLen);
     }
     return "";
 }
 
 std::string HttpRequest::GetPost(const char* key) const {
     assert(key != nullptr);
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
+    const Field* field = FindField_(post_, key, strlen(key), false);
+    if(field) {
+        return std::string(&arena_[field->value], field->valueLen);
     }
     return "";
-}
\ No newline at end of file
+}
+
+std::string HttpRequest::GetQuery(const std::string& key) const {
+    assert(key != "");
+    const Field* field = FindField_(query_, key.data(), key.size(), false);
+    if(field) {
+        return std::string(&arena_[field->value], field->valueLen);
+    }
+    return "";
+}
+
+std::string HttpRequest::GetHeader(const std::string& key) const {
+    size_t len = 0;
+    const char* value = HeaderValue(key.c_str(), &len);
+    if(value) {
+        return std::string(value, len);
+    }
+    return "";
+}
+
+const char* HttpRequest::HeaderValue(const char* key, size_t* len) const {
+    const Field* field = FindField_(header_, key, strlen(key), true);
+    if(!field) {
+        return nullptr;
+    }
+    if(len) { *len = field->valueLen; }
+    return &arena_[field->value];
+}
@@ -1,14 +1,24 @@
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex>
+#include <vector>
+#include <functional>
+#include <atomic>
 #include <errno.h>
+#include <string.h>
+#include <strings.h>
 #include <mysql/mysql.h>
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAll.h"
 
+/* 请求体按块交给处理函数, 返回false表示拒绝该请求 */
+typedef std::function<bool(const char* data, size_t len)> BodyHandler;
+
 class HttpRequest{
 public:
     enum PARSE_STATE {
@@ -18,6 +28,13 @@ public:
         FINISH,        
     };
 
+    enum BODY_STATE {
+        BODY_DATA,
+        CHUNK_SIZE,
+        CHUNK_END,
+        CHUNK_TRAILER,
+    };
+
     enum HTTP_CODE {
         NO_REQUEST = 0,
         GET_REQUEST,
@@ -27,22 +44,54 @@ public:
         FILE_REQUEST,
         INTERNAL_ERROR,
         CLOSED_CONNECTION,
+        PAYLOAD_TOO_LARGE,
+        URI_TOO_LONG,
+        HEADER_TOO_LARGE,
     };
 
-    HttpRequest() { Init(); }
+    HttpRequest() {
+        arena_.reserve(1024);
+        header_.reserve(16);
+        Init();
+    }
     ~HttpRequest() = default;
 
     void Init();
-    bool parse(Buffer& buff);
+    /* NO_REQUEST: 请求不完整, 需要继续读; GET_REQUEST: 解析完成; 其余为错误 */
+    HTTP_CODE parse(Buffer& buff);
 
-    std::string path() const;
+    const std::string& path() const;
     std::string& path();
-    std::string method() const;
-    std::string version() const;
+    const std::string& method() const;
+    const std::string& version() const;
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
+    std::string GetQuery(const std::string& key) const;
+    std::string GetHeader(const std::string& key) const;
+    /* 头部名不区分大小写, 不存在时返回nullptr; 返回值在下一个请求开始解析前有效 */
+    const char* HeaderValue(const char* key, size_t* len = nullptr) const;
 
     bool IsKeepAlive() const;
+    bool TakeExpectContinue();
+    /* 还在等待请求行或请求头(包括上一个请求已完成, 下一个尚未开始) */
+    bool AwaitingHeader() const {
+        return state_ == REQUEST_LINE || state_ == HEADERS || state_ == FINISH;
+    }
+
+    /* 解码 %XX (plusAsSpace 时把 '+' 解码为空格), 非法的 % 原样保留; dst 可以等于 src */
+    static size_t UrlDecode(const char* src, size_t len, char* dst, bool plusAsSpace);
+
+    /* 请求之间没有未处理的数据: 上一个请求已完成或还没开始读 */
+    bool BetweenRequests() const {
+        return state_ == REQUEST_LINE || state_ == FINISH;
+    }
+
+    /* 以下上限可在运行中重新加载(SIGHUP), 工作线程并发读取 */
+    static std::atomic<size_t> maxBodySize;   // 请求体总长度上限
+    static std::atomic<size_t> maxFormSize;   // 未交给BodyHandler时在内存中缓存的上限
+    static std::atomic<size_t> maxLineSize;   // 请求行/头部行/chunk行的长度上限
+    static std::atomic<size_t> maxHeaderSize; // 请求行加全部头部的字节数上限
+    static std::atomic<size_t> maxHeaderCount;
 
     /* 
     todo 
@@ -51,23 +100,52 @@ public:
     */
 
 private:
-    bool ParseRequestLine_(const std::string& line);
-    void ParseHeader_(const std::string& line);
-    void ParseBody_(const std::string& line);
+    /* 头部/表单字段在 arena_ 中的位置, 名和值都以'\0'结尾 */
+    struct Field {
+        uint32_t key;
+        uint32_t keyLen;
+        uint32_t value;
+        uint32_t valueLen;
+    };
+
+    bool ParseRequestLine_(const char* begin, const char* end);
+    bool ParseTarget_(const char* begin, const char* end);
+    HTTP_CODE ParseHeader_(const char* begin, const char* end);
+    HTTP_CODE ParseHeadersEnd_();
+    HTTP_CODE ParseBody_(Buffer& buff);
+    HTTP_CODE ParseChunkLine_(const char* begin, const char* end);
+    HTTP_CODE LineTooLong_() const;
+    HTTP_CODE OnBodyData_(const char* data, size_t len);
+    void FinishBody_();
 
-    void ParsePath_();
     void ParsePost_();
-    void ParseFromUrlencoded_();
+    void ParseUrlencoded_(const char* data, size_t len, std::vector<Field>& fields);
 
-    static bool UserVerify(const std::string& name,const std::string& pwd,bool isLogin);
+    uint32_t Intern_(const char* str, size_t len);
+    uint32_t InternDecoded_(const char* str, size_t len, uint32_t* decodedLen);
+    const Field* FindField_(const std::vector<Field>& fields, const char* key,
+                            size_t keyLen, bool ignoreCase) const;
 
     PARSE_STATE state_;
+    BODY_STATE bodyState_;
+    size_t bodyRemain_;
+    size_t bodyLen_;
+    size_t bodyLimit_;   // 头部结束时取 maxBodySize 的快照, 重新加载配置不影响读到一半的请求体
+    size_t lineScan_;    // 当前行已扫描过的字节数
+    size_t headerBytes_;
+    bool chunked_;
+    bool expectContinue_;
+    BodyHandler bodyHandler_;
     std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
+    /* 每个连接一份, 请求之间只清空不释放, 稳定后解析头部不再分配内存 */
+    std::vector<char> arena_;
+    std::vector<Field> header_;
+    std::vector<Field> post_;
+    std::vector<Field> query_;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
     static int ConverHex(char ch);
+    static void NormalizePath_(std::string& path);
+
+};
 
-};
\ No newline at end of file
+#endif // HTTP_REQUEST_H
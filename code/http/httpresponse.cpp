@@ -1,35 +1,19 @@
 #include "httpresponse.h"
+#include "httptables.h"
 
 using namespace std;
 
-const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
+/* 字面量直接按长度拷贝, 不构造临时 string */
+template<size_t N>
+static inline void AppendStr(Buffer& buff, const char (&str)[N]) {
+    buff.Append(str, N - 1);
+}
 
-const unordered_map<int, string> HttpResponse::CODE_STATUS = {
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
-};
+static inline void AppendNum(Buffer& buff, unsigned long long num) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%llu", num);
+    buff.Append(buf, n);
+}
 
 const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 400, "/400.html" },
@@ -37,11 +21,22 @@ const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 404, "/404.html" },
 };
 
+const char HttpResponse::BOUNDARY[] = "WEBSERVER_BYTERANGES";
+
+std::atomic<bool> HttpResponse::gzipOnTheFly(true);
+std::atomic<size_t> HttpResponse::coldReadMin(32 * 1024);
+
 HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr; 
+    isStreaming_ = false;
+    chunked_ = true;
+    onTheFly_ = false;
+    bundle_ = nullptr;
+    bundleGzip_ = false;
+    mmFile_ = file_ = nullptr; 
+    mmLen_ = fileLen_ = 0;
     mmFileStat_ = { 0 };
 };
 
@@ -51,25 +46,107 @@ HttpResponse::~HttpResponse() {
 
 void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
     assert(srcDir != "");
-    if(mmFile_) { UnmapFile(); }
+    if(mmFile_ || fileRead_) { UnmapFile(); }
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmFile_ = nullptr; 
+    isStreaming_ = false;
+    chunked_ = true;
+    generator_ = nullptr;
+    range_ = ifRange_ = ifNoneMatch_ = ifModifiedSince_ = acceptEncoding_ = "";
+    encoding_ = encodedSuffix_ = "";
+    onTheFly_ = false;
+    compressed_ = nullptr;
+    bundle_ = nullptr;
+    bundleGzip_ = false;
+    ranges_.clear();
+    mmFile_ = file_ = nullptr; 
+    mmLen_ = fileLen_ = 0;
     mmFileStat_ = { 0 };
 }
 
+void HttpResponse::SetValidators(const string& ifNoneMatch, const string& ifModifiedSince) {
+    ifNoneMatch_ = ifNoneMatch;
+    ifModifiedSince_ = ifModifiedSince;
+}
+
+void HttpResponse::SetRange(const string& range, const string& ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
+}
+
+void HttpResponse::SetGenerator(const BodyGenerator& generator, const string& type) {
+    assert(generator);
+    isStreaming_ = true;
+    generator_ = generator;
+    streamType_ = type;
+}
+
+void HttpResponse::NextChunk(Buffer& buff) {
+    assert(generator_);
+    chunkBuff_.RetrieveAll();
+    bool more = generator_(chunkBuff_);
+    size_t len = chunkBuff_.ReadableBytes();
+    if(!chunked_) {
+        buff.Append(chunkBuff_);
+        if(!more) { generator_ = nullptr; }
+        return;
+    }
+    if(len > 0) {
+        char head[24];
+        int n = snprintf(head, sizeof(head), "%zx\r\n", len);
+        buff.Append(head, n);
+        buff.Append(chunkBuff_);
+        buff.Append("\r\n", 2);
+    }
+    if(!more) {
+        /* 最后一个空块表示响应结束 */
+        buff.Append("0\r\n\r\n", 5);
+        generator_ = nullptr;
+    }
+}
+
 void HttpResponse::MakeResponse(Buffer& buff) {
-    /* 判断请求的资源文件 */
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
+    if(isStreaming_) {
+        if(code_ == -1) { code_ = 200; }
+        if(!chunked_) {
+            /* 没有长度也没有分块, 响应体到连接关闭为止 */
+            isKeepAlive_ = false;
+        }
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        buff.Append(chunked_ ? "Transfer-Encoding: chunked\r\n\r\n" : "\r\n");
+        return;
+    }
+    /* 判断请求的资源文件, 已经确定的错误码不再被覆盖 */
+    if(code_ < 400) {
+        if(FindBundle_()) {
+            if(code_ == -1) { code_ = 200; }
+            Metrics::Add(Metrics::BUNDLE_HITS);
+        }
+        else if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
+            code_ = 404;
+        }
+        else if(!(mmFileStat_.st_mode & S_IROTH)) {
+            code_ = 403;
+        }
+        else if(code_ == -1) { 
+            code_ = 200; 
+        }
     }
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
-        code_ = 403;
+    if(code_ == 200) {
+        SelectEncoding_();
     }
-    else if(code_ == -1) { 
-        code_ = 200; 
+    if(code_ == 200 && NotModified_()) {
+        code_ = 304;
+    }
+    else if(onTheFly_ && !CompressOnTheFly_()) {
+        encoding_ = "";
+        onTheFly_ = false;
+    }
+    else if(code_ == 200 && range_ != "" && IfRangeMatch_()) {
+        code_ = ParseRange_() ? (ranges_.empty() ? 200 : 206) : 416;
     }
     ErrorHtml_();
     AddStateLine_(buff);
@@ -78,81 +155,490 @@ void HttpResponse::MakeResponse(Buffer& buff) {
 }
 
 char* HttpResponse::File() {
-    return mmFile_;
+    return file_;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    return fileLen_;
+}
+
+bool HttpResponse::ParseRange_() {
+    /*
+        bytes=first-last, first-, -suffix; 多个区间用逗号分隔
+        返回 false 表示语法正确但没有可满足的区间(416), 语法错误的 Range 头忽略, 返回整个文件
+    */
+    off_t size = mmFileStat_.st_size;
+    if(range_.compare(0, 6, "bytes=") != 0) {
+        return true;
+    }
+    off_t total = 0;
+    bool satisfiable = false;
+    const char* p = range_.c_str() + 6;
+    while(*p) {
+        while(*p == ' ' || *p == ',') { p++; }
+        if(!*p) { break; }
+        char* end = nullptr;
+        off_t first = -1, last = size - 1;
+        if(*p == '-') {
+            if(!isdigit(p[1])) { return InvalidRange_(); }
+            off_t suffix = strtoll(p + 1, &end, 10);
+            /* -0 语法正确, 但不可满足 */
+            if(suffix <= 0 || size == 0) {
+                p = end;
+                continue;
+            }
+            first = suffix >= size ? 0 : size - suffix;
+        }
+        else {
+            if(!isdigit(*p)) { return InvalidRange_(); }
+            first = strtoll(p, &end, 10);
+            if(*end != '-') { return InvalidRange_(); }
+            p = end + 1;
+            if(isdigit(*p)) {
+                off_t value = strtoll(p, &end, 10);
+                if(value < first) { return InvalidRange_(); }
+                last = min(value, size - 1);
+            }
+            else {
+                end = const_cast<char*>(p);
+            }
+        }
+        p = end;
+        while(*p == ' ') { p++; }
+        if(*p && *p != ',') { return InvalidRange_(); }
+        /* 不可满足的区间跳过 */
+        if(first >= size) { continue; }
+        satisfiable = true;
+        ranges_.emplace_back(first, last);
+        total += last - first + 1;
+        if(ranges_.size() > MAX_RANGES) { return InvalidRange_(); }
+    }
+    if(!satisfiable) {
+        return false;
+    }
+    if(total > size || (ranges_.size() > 1 && total > static_cast<off_t>(MAX_MULTIPART_SIZE))) {
+        /* 区间重叠过多视为滥用; 多区间的内容要拷贝进写缓冲区, 太大时改为零拷贝地返回整个文件 */
+        ranges_.clear();
+    }
+    return true;
+}
+
+bool HttpResponse::InvalidRange_() {
+    ranges_.clear();
+    return true;
+}
+
+bool HttpResponse::IfRangeMatch_() const {
+    /* 没有 If-Range 或者资源未变化时 Range 才生效, 否则返回完整内容 */
+    if(ifRange_ == "") {
+        return true;
+    }
+    if(ifRange_[0] == '"') {
+        return ifRange_ == ETag_();
+    }
+    return ifRange_ == HttpDate_(mmFileStat_.st_mtime);
+}
+
+bool HttpResponse::NotModified_() const {
+    /* 只比较 stat 得到的元数据, 不读取文件内容 */
+    if(ifNoneMatch_ != "") {
+        /* 弱比较: 忽略 W/ 前缀, 支持逗号分隔的多个值和 * */
+        string etag = ETag_();
+        size_t pos = 0;
+        while(pos < ifNoneMatch_.size()) {
+            size_t end = ifNoneMatch_.find(',', pos);
+            if(end == string::npos) { end = ifNoneMatch_.size(); }
+            size_t b = ifNoneMatch_.find_first_not_of(' ', pos);
+            size_t e = ifNoneMatch_.find_last_not_of(' ', end - 1);
+            if(b != string::npos && b < end && e >= b) {
+                string tag = ifNoneMatch_.substr(b, e - b + 1);
+                if(tag.compare(0, 2, "W/") == 0) { tag = tag.substr(2); }
+                if(tag == "*" || tag == etag) { return true; }
+            }
+            pos = end + 1;
+        }
+        return false;
+    }
+    if(ifModifiedSince_ != "") {
+        struct tm tm = { 0 };
+        const char* end = strptime(ifModifiedSince_.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        if(!end) { return false; }
+        return mmFileStat_.st_mtime <= timegm(&tm);
+    }
+    return false;
+}
+
+bool HttpResponse::FindBundle_() {
+    bundle_ = Bundle::Instance()->Find(path_);
+    if(!bundle_) {
+        return false;
+    }
+    /* Last-Modified 和 Range 沿用 stat 的字段 */
+    mmFileStat_ = { 0 };
+    mmFileStat_.st_size = bundle_->dataLen;
+    mmFileStat_.st_mtime = bundle_->mtime;
+    return true;
+}
+
+string HttpResponse::ETag_() const {
+    if(bundle_) {
+        /* 构建时按内容计算好的 ETag */
+        string etag = Bundle::Instance()->Str(bundle_->etagOff, bundle_->etagLen);
+        if(bundleGzip_) { etag.insert(etag.size() - 1, "-gzip"); }
+        return etag;
+    }
+    /* inode-大小-修改时间, 文件被替换或修改后都会变化; 即时压缩的版本加上编码区分 */
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx%s\"", (unsigned long)mmFileStat_.st_ino,
+                     (unsigned long)mmFileStat_.st_size, (unsigned long)mmFileStat_.st_mtime,
+                     onTheFly_ ? "-gzip" : "");
+    return string(buf, n);
+}
+
+void HttpResponse::SelectEncoding_() {
+    if(acceptEncoding_ == "") {
+        return;
+    }
+    if(bundle_) {
+        /* 资源包里的 gzip 版本同样不按区间发送 */
+        if(bundle_->gzipLen > 0 && range_ == "" && Accepts_(acceptEncoding_, "gzip")) {
+            encoding_ = "gzip";
+            bundleGzip_ = true;
+        }
+        return;
+    }
+    /* 预压缩文件: 比原文件旧的视为过期, 不使用 */
+    static const char* const SIBLINGS[][2] = { { ".br", "br" }, { ".gz", "gzip" } };
+    for(auto& sibling: SIBLINGS) {
+        struct stat st;
+        if(Accepts_(acceptEncoding_, sibling[1])
+            && stat((srcDir_ + path_ + sibling[0]).data(), &st) == 0
+            && S_ISREG(st.st_mode) && (st.st_mode & S_IROTH)
+            && st.st_mtime >= mmFileStat_.st_mtime) {
+            encoding_ = sibling[1];
+            encodedSuffix_ = sibling[0];
+            mmFileStat_ = st;
+            return;
+        }
+    }
+    /* 即时压缩的内容不支持按区间发送 */
+    if(gzipOnTheFly && range_ == "" && Accepts_(acceptEncoding_, "gzip") && IsCompressible_()) {
+        encoding_ = "gzip";
+        onTheFly_ = true;
+    }
+}
+
+bool HttpResponse::CompressOnTheFly_() {
+    string key = srcDir_ + path_;
+    compressed_ = CompressCache::Instance()->Get(key, mmFileStat_.st_mtime, mmFileStat_.st_size);
+    Metrics::Add(compressed_ ? Metrics::GZIP_CACHE_HITS : Metrics::GZIP_CACHE_MISSES);
+    if(!compressed_) {
+        int fd = open(key.data(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) { return false; }
+        void* data = mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED) { return false; }
+        shared_ptr<string> out = make_shared<string>();
+        bool ok = CompressCache::Gzip(static_cast<char*>(data), mmFileStat_.st_size, *out);
+        munmap(data, mmFileStat_.st_size);
+        if(!ok) { return false; }
+        LOG_DEBUG("gzip %s: %d -> %d", path_.data(), (int)mmFileStat_.st_size, (int)out->size());
+        compressed_ = out;
+        CompressCache::Instance()->Put(key, mmFileStat_.st_mtime, mmFileStat_.st_size, compressed_);
+    }
+    /* 压缩后没有变小则发送原文件 */
+    if(compressed_->size() >= static_cast<size_t>(mmFileStat_.st_size)) {
+        compressed_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool HttpResponse::IsCompressible_() {
+    if(mmFileStat_.st_size < static_cast<off_t>(GZIP_MIN_SIZE)
+        || mmFileStat_.st_size > static_cast<off_t>(GZIP_MAX_SIZE)) {
+        return false;
+    }
+    return IsTextType(GetFileType_());
+}
+
+bool HttpResponse::IsTextType(const string& type) {
+    return type.compare(0, 5, "text/") == 0 || type.find("javascript") != string::npos
+        || type.find("xml") != string::npos || type.find("json") != string::npos;
+}
+
+bool HttpResponse::Accepts_(const string& header, const char* coding) {
+    /* 逗号分隔的编码列表, q=0 表示不接受 */
+    size_t len = strlen(coding);
+    size_t pos = 0;
+    while(pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if(end == string::npos) { end = header.size(); }
+        size_t b = header.find_first_not_of(' ', pos);
+        if(b < end && strncasecmp(header.data() + b, coding, len) == 0) {
+            size_t after = b + len;
+            if(after == end || header[after] == ';' || header[after] == ' ') {
+                size_t q = header.find("q=", after);
+                return q >= end || atof(header.data() + q + 2) > 0;
+            }
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+string HttpResponse::HttpDate_(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return string(buf, n);
 }
 
 void HttpResponse::ErrorHtml_() {
     if(CODE_PATH.count(code_) == 1) {
         path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+        if(!FindBundle_()) {
+            stat((srcDir_ + path_).data(), &mmFileStat_);
+        }
     }
 }
 
 void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+    const StatusText* status = FindStatus(code_);
+    if(!status) {
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        status = FindStatus(400);
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    buff.Append(status->line, status->lineLen);
 }
 
 void HttpResponse::AddHeader_(Buffer& buff) {
-    buff.Append("Connection: ");
     if(isKeepAlive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+        AppendStr(buff, "Connection: keep-alive\r\n"
+                        "keep-alive: max=6, timeout=120\r\n");
     } else{
-        buff.Append("close\r\n");
+        AppendStr(buff, "Connection: close\r\n");
+    }
+    AppendStr(buff, "Content-type: ");
+    if(code_ == 206 && ranges_.size() > 1) {
+        AppendStr(buff, "multipart/byteranges; boundary=");
+        buff.Append(BOUNDARY, sizeof(BOUNDARY) - 1);
+    }
+    else if(isStreaming_) {
+        buff.Append(streamType_);
+    }
+    else {
+        AppendFileType_(buff);
+    }
+    AppendStr(buff, "\r\n");
+    /* 生成的内容没有对应的文件, 不给校验头, 也不支持 Range */
+    if(isStreaming_) {
+        AppendStr(buff, "Cache-Control: no-store\r\n");
+    }
+    else if(code_ == 200 || code_ == 206 || code_ == 304) {
+        AppendStr(buff, "Accept-Ranges: bytes\r\nETag: ");
+        buff.Append(ETag_());
+        AppendStr(buff, "\r\nLast-Modified: ");
+        buff.Append(HttpDate_(mmFileStat_.st_mtime));
+        AppendStr(buff, "\r\nVary: Accept-Encoding\r\n");
+        if(encoding_ != "") {
+            AppendStr(buff, "Content-Encoding: ");
+            buff.Append(encoding_);
+            AppendStr(buff, "\r\n");
+        }
+    }
+    else if(code_ == 416) {
+        AppendStr(buff, "Content-Range: bytes */");
+        AppendNum(buff, mmFileStat_.st_size);
+        AppendStr(buff, "\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
+    if(code_ >= 400 && CODE_PATH.count(code_) == 0) {
+        /* 没有对应错误页面, 直接生成 */
+        ErrorContent(buff, FindStatus(code_)->reason);
+        return;
+    }
+    if(code_ == 304) {
+        /* 304 没有响应体, 也不需要打开文件 */
+        buff.Append("\r\n");
+        return;
+    }
+    if(bundle_) {
+        AddBundleContent_(buff);
+        return;
+    }
+    if(onTheFly_) {
+        /* 直接发送缓存中的压缩内容 */
+        file_ = const_cast<char*>(compressed_->data());
+        fileLen_ = compressed_->size();
+        AppendStr(buff, "Content-length: ");
+        AppendNum(buff, fileLen_);
+        AppendStr(buff, "\r\n\r\n");
+        return;
+    }
+    int srcFd = open((srcDir_ + path_ + encodedSuffix_).data(), O_RDONLY | O_CLOEXEC);
     if(srcFd < 0) { 
         ErrorContent(buff, "File NotFound!");
         return; 
     }
+    LOG_DEBUG("file path %s", (srcDir_ + path_ + encodedSuffix_).data());
+    if(code_ == 206 && ranges_.size() > 1) {
+        AddMultipart_(buff, srcFd);
+        close(srcFd);
+        return;
+    }
 
-    /* 将文件映射到内存提高文件的访问速度 
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
+    off_t offset = 0;
+    size_t len = mmFileStat_.st_size;
+    if(code_ == 206) {
+        offset = ranges_[0].first;
+        len = ranges_[0].second - ranges_[0].first + 1;
+        buff.Append("Content-Range: bytes " + to_string(ranges_[0].first) + "-"
+                    + to_string(ranges_[0].second) + "/" + to_string(mmFileStat_.st_size) + "\r\n");
+    }
+    if(!MapFile_(srcFd, offset, len)) {
+        close(srcFd);
         ErrorContent(buff, "File NotFound!");
         return; 
     }
+    shared_ptr<FileRead> read;
+    if(IsColdFile_() && (read = FileReader::Instance()->Open(srcFd, offset, len))) {
+        /* 文件不在页缓存中, 改由读线程分块读入, fd 交给 fileRead_ */
+        UnmapFile();
+        fileRead_ = move(read);
+        Metrics::Add(Metrics::COLD_READS);
+    }
+    else {
+        close(srcFd);
+    }
+    AppendStr(buff, "Content-length: ");
+    AppendNum(buff, len);
+    AppendStr(buff, "\r\n\r\n");
+}
+
+bool HttpResponse::MapFile_(int fd, off_t offset, size_t len) {
+    /* 将文件映射到内存提高文件的访问速度, 只映射要发送的区间
+        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
+    if(len == 0) { return true; }
+    static const off_t pageSize = sysconf(_SC_PAGESIZE);
+    off_t aligned = offset / pageSize * pageSize;
+    size_t mapLen = len + (offset - aligned);
+    void* mmRet = mmap(0, mapLen, PROT_READ, MAP_PRIVATE, fd, aligned);
+    if(mmRet == MAP_FAILED) {
+        return false;
+    }
     mmFile_ = (char*)mmRet;
-    close(srcFd);
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    mmLen_ = mapLen;
+    file_ = mmFile_ + (offset - aligned);
+    fileLen_ = len;
+    return true;
+}
+
+bool HttpResponse::IsColdFile_() const {
+    /* mincore 只查询页缓存, 不会触发读盘 */
+    if(coldReadMin == 0 || fileLen_ < coldReadMin || !FileReader::Instance()->IsOpen()) {
+        return false;
+    }
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    vector<unsigned char> pages((mmLen_ + pageSize - 1) / pageSize);
+    if(mincore(mmFile_, mmLen_, pages.data()) != 0) {
+        return false;
+    }
+    for(unsigned char page: pages) {
+        if(!(page & 1)) { return true; }
+    }
+    return false;
+}
+
+void HttpResponse::AddBundleContent_(Buffer& buff) {
+    /* 直接指向资源包的映射区, 不需要打开和映射文件 */
+    Bundle* bundle = Bundle::Instance();
+    const char* data = bundle->Data(bundleGzip_ ? bundle_->gzipOff : bundle_->dataOff);
+    size_t len = bundleGzip_ ? bundle_->gzipLen : bundle_->dataLen;
+    if(code_ == 206 && ranges_.size() > 1) {
+        AddMultipart_(buff, -1, data);
+        return;
+    }
+    if(code_ == 206) {
+        data += ranges_[0].first;
+        len = ranges_[0].second - ranges_[0].first + 1;
+        buff.Append("Content-Range: bytes " + to_string(ranges_[0].first) + "-"
+                    + to_string(ranges_[0].second) + "/" + to_string(mmFileStat_.st_size) + "\r\n");
+    }
+    file_ = const_cast<char*>(data);
+    fileLen_ = len;
+    AppendStr(buff, "Content-length: ");
+    AppendNum(buff, len);
+    AppendStr(buff, "\r\n\r\n");
+}
+
+void HttpResponse::AddMultipart_(Buffer& buff, int fd, const char* mem) {
+    /* 多区间较少见, 各段内容直接拷贝进写缓冲区, 总量由 ParseRange_ 限制在 MAX_MULTIPART_SIZE 以内 */
+    string type = GetFileType_();
+    vector<string> heads;
+    size_t total = 0;
+    for(auto& r: ranges_) {
+        heads.push_back("\r\n--" + string(BOUNDARY) + "\r\nContent-type: " + type
+                        + "\r\nContent-Range: bytes " + to_string(r.first) + "-" + to_string(r.second)
+                        + "/" + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+        total += heads.back().size() + (r.second - r.first + 1);
+    }
+    string tail = "\r\n--" + string(BOUNDARY) + "--\r\n";
+    total += tail.size();
+    AppendStr(buff, "Content-length: ");
+    AppendNum(buff, total);
+    AppendStr(buff, "\r\n\r\n");
+    for(size_t i = 0; i < ranges_.size(); i++) {
+        buff.Append(heads[i]);
+        size_t len = ranges_[i].second - ranges_[i].first + 1;
+        if(mem) {
+            buff.Append(mem + ranges_[i].first, len);
+            continue;
+        }
+        buff.EnsureWriteable(len);
+        ssize_t n = pread(fd, buff.BeginWrite(), len, ranges_[i].first);
+        if(n < static_cast<ssize_t>(len)) {
+            /* 文件被截断, 用0补齐以保证长度正确 */
+            memset(buff.BeginWrite() + max<ssize_t>(n, 0), 0, len - max<ssize_t>(n, 0));
+        }
+        buff.HasWritten(len);
+    }
+    buff.Append(tail);
 }
 
 void HttpResponse::UnmapFile() {
+    /* 没有被连接取走的后台读取, 随之释放文件和缓冲块 */
+    fileRead_ = nullptr;
     if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
+        munmap(mmFile_, mmLen_);
+        mmFile_ = file_ = nullptr;
+        mmLen_ = fileLen_ = 0;
     }
 }
 
 string HttpResponse::GetFileType_() {
-    /* 判断文件类型 */
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos) {
-        return "text/plain";
+    if(bundle_) {
+        return Bundle::Instance()->Str(bundle_->typeOff, bundle_->typeLen);
     }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    return MimeType(path_);
+}
+
+void HttpResponse::AppendFileType_(Buffer& buff) {
+    if(bundle_) {
+        buff.Append(Bundle::Instance()->Data(bundle_->typeOff), bundle_->typeLen);
+        return;
     }
-    return "text/plain";
+    const MimeEntry& mime = FindMime(path_.data(), path_.size());
+    buff.Append(mime.type, mime.typeLen);
+}
+
+string HttpResponse::MimeType(const string& path) {
+    /* 判断文件类型 */
+    const MimeEntry& mime = FindMime(path.data(), path.size());
+    return string(mime.type, mime.typeLen);
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, string message) 
@@ -161,8 +647,8 @@ void HttpResponse::ErrorContent(Buffer& buff, string message)
     string status;
     body += "<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\">";
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
+    if(FindStatus(code_)) {
+        status = FindStatus(code_)->reason;
     } else {
         status = "Bad Request";
     }
@@ -170,6 +656,8 @@ void HttpResponse::ErrorContent(Buffer& buff, string message)
     body += "<p>" + message + "</p>";
     body += "<hr><em>TinyWebServer</em></body></html>";
 
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
+    AppendStr(buff, "Content-length: ");
+    AppendNum(buff, body.size());
+    AppendStr(buff, "\r\n\r\n");
     buff.Append(body);
 }
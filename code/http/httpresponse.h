@@ -2,6 +2,12 @@
 #define HTTP_RESPONSE_H
 
 #include <unordered_map>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <atomic>
+#include <time.h>
 #include <fcntl.h>       // open
 #include <unistd.h>      // close
 #include <sys/stat.h>    // stat
@@ -9,6 +15,16 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../pool/compresscache.h"
+#include "../pool/filereader.h"
+#include "bundle.h"
+#include "../metrics/metrics.h"
+
+/*
+    流式响应的内容生成器: 每次调用向 out 追加下一段内容, 返回false表示已生成完毕
+    只在连接可写(EPOLLOUT)且上一段已发送完时才会被调用, 单次追加的量即为背压的粒度
+*/
+typedef std::function<bool(Buffer& out)> BodyGenerator;
 
 class HttpResponse {
 public:
@@ -22,6 +38,31 @@ public:
     size_t FileLen() const;
     void ErrorContent(Buffer& buff, std::string message);
     int Code() const { return code_; }
+    bool IsKeepAlive() const { return isKeepAlive_; }
+    void SetPath(const std::string& path) { path_ = path; }
+    /* 请求中的 Range / If-Range 头, 只作用于 200 的文件响应 */
+    void SetRange(const std::string& range, const std::string& ifRange);
+    /* 请求中的 If-None-Match / If-Modified-Since 头, 资源未变化时返回304 */
+    void SetValidators(const std::string& ifNoneMatch, const std::string& ifModifiedSince);
+    /* 请求中的 Accept-Encoding 头, 优先发送预压缩的 .br/.gz 文件 */
+    void SetAcceptEncoding(const std::string& acceptEncoding) { acceptEncoding_ = acceptEncoding; }
+
+    static std::string MimeType(const std::string& path);
+    static bool IsTextType(const std::string& type);
+
+    static std::atomic<bool> gzipOnTheFly;      // 没有预压缩文件时是否即时压缩文本并缓存
+    static std::atomic<size_t> coldReadMin;     // 不在页缓存中且不小于该值的文件交给读线程, 0 表示总是 mmap
+
+    /* 冷文件的后台读取, 此时 File() 为空, 内容由连接按块取出发送 */
+    std::shared_ptr<FileRead> TakeFileRead() { return std::move(fileRead_); }
+
+    /* 以 chunked 编码发送 generator 生成的内容, 不再读取文件 */
+    void SetGenerator(const BodyGenerator& generator, const std::string& type = "text/html");
+    /* HTTP/1.0 的客户端不认识 chunked, 流式内容直接发送, 以关闭连接表示结束 */
+    void SetChunked(bool chunked) { chunked_ = chunked; }
+    bool IsStreaming() const { return isStreaming_; }
+    bool StreamDone() const { return !generator_; }
+    void NextChunk(Buffer& buff);
 
 private:
     void AddStateLine_(Buffer &buff);
@@ -30,19 +71,64 @@ private:
 
     void ErrorHtml_();
     std::string GetFileType_();
+    void AppendFileType_(Buffer& buff);
+
+    bool ParseRange_();
+    bool InvalidRange_();
+    bool IfRangeMatch_() const;
+    bool NotModified_() const;
+    std::string ETag_() const;
+    void SelectEncoding_();
+    bool CompressOnTheFly_();
+    bool IsCompressible_();
+    static bool Accepts_(const std::string& header, const char* coding);
+    bool MapFile_(int fd, off_t offset, size_t len);
+    bool IsColdFile_() const;
+    void AddMultipart_(Buffer& buff, int fd, const char* mem = nullptr);
+    bool FindBundle_();
+    void AddBundleContent_(Buffer& buff);
+    static std::string HttpDate_(time_t t);
 
     int code_;
     bool isKeepAlive_;
 
     std::string path_;
     std::string srcDir_;
+
+    bool isStreaming_;
+    bool chunked_;
+    BodyGenerator generator_;
+    std::string streamType_;
+    Buffer chunkBuff_;
     
-    char* mmFile_; 
+    char* mmFile_;      // 映射区起始, 按页对齐
+    size_t mmLen_;
+    char* file_;        // 要发送的内容在映射区中的位置
+    size_t fileLen_;
     struct stat mmFileStat_;
+    std::shared_ptr<FileRead> fileRead_;
+
+    std::string range_;
+    std::string ifRange_;
+    std::string ifNoneMatch_;
+    std::string ifModifiedSince_;
+    std::string acceptEncoding_;
+
+    std::string encoding_;          // 为空时发送原文件
+    std::string encodedSuffix_;     // 预压缩文件的后缀
+    bool onTheFly_;
+    std::shared_ptr<const std::string> compressed_;
+
+    const BundleEntry* bundle_;     // 命中资源包时不再访问磁盘
+    bool bundleGzip_;
+    std::vector<std::pair<off_t, off_t>> ranges_;   // 闭区间 [first, last]
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
+    static const size_t MAX_RANGES = 16;
+    static const size_t MAX_MULTIPART_SIZE = 1024 * 1024;
+    static const char BOUNDARY[];
+    static const size_t GZIP_MIN_SIZE = 256;
+    static const size_t GZIP_MAX_SIZE = 8 * 1024 * 1024;
 };
 
 
@@ -0,0 +1,123 @@
+#include "httpscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+typedef const char* (*FindCRLFFunc)(const char*, const char*);
+typedef const char* (*FindAnyOfFunc)(const char*, const char*, const char*, int);
+
+static const char* FindCRLFScalar(const char* p, const char* end) {
+    for(; p + 1 < end; p++) {
+        if(p[0] == '\r' && p[1] == '\n') { return p; }
+    }
+    return end;
+}
+
+static const char* FindAnyOfScalar(const char* p, const char* end, const char* chars, int n) {
+    for(; p < end; p++) {
+        for(int i = 0; i < n; i++) {
+            if(*p == chars[i]) { return p; }
+        }
+    }
+    return end;
+}
+
+#ifdef SCAN_X86
+
+/* 不足4个字符时用第一个字符补齐, 比较结果不变 */
+#define SCAN_CHAR(chars, n, i) ((i) < (n) ? (chars)[i] : (chars)[0])
+
+static const char* FindCRLFSse2(const char* p, const char* end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    /* 同时比较 p[i]=='\r' 和 p[i+1]=='\n', 第二次加载多读1字节 */
+    for(; end - p >= 17; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindCRLFScalar(p, end);
+}
+
+static const char* FindAnyOfSse2(const char* p, const char* end, const char* chars, int n) {
+    const __m128i c0 = _mm_set1_epi8(SCAN_CHAR(chars, n, 0));
+    const __m128i c1 = _mm_set1_epi8(SCAN_CHAR(chars, n, 1));
+    const __m128i c2 = _mm_set1_epi8(SCAN_CHAR(chars, n, 2));
+    const __m128i c3 = _mm_set1_epi8(SCAN_CHAR(chars, n, 3));
+    for(; end - p >= 16; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(a, c0), _mm_cmpeq_epi8(a, c1)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(a, c2), _mm_cmpeq_epi8(a, c3)));
+        int mask = _mm_movemask_epi8(eq);
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindAnyOfScalar(p, end, chars, n);
+}
+
+__attribute__((target("avx2")))
+static const char* FindCRLFAvx2(const char* p, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for(; end - p >= 33; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr),
+                                                              _mm256_cmpeq_epi8(b, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindCRLFSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* FindAnyOfAvx2(const char* p, const char* end, const char* chars, int n) {
+    const __m256i c0 = _mm256_set1_epi8(SCAN_CHAR(chars, n, 0));
+    const __m256i c1 = _mm256_set1_epi8(SCAN_CHAR(chars, n, 1));
+    const __m256i c2 = _mm256_set1_epi8(SCAN_CHAR(chars, n, 2));
+    const __m256i c3 = _mm256_set1_epi8(SCAN_CHAR(chars, n, 3));
+    for(; end - p >= 32; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i eq = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, c0), _mm256_cmpeq_epi8(a, c1)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(a, c2), _mm256_cmpeq_epi8(a, c3)));
+        unsigned mask = _mm256_movemask_epi8(eq);
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindAnyOfSse2(p, end, chars, n);
+}
+
+#endif // SCAN_X86
+
+struct ScanFuncs {
+    FindCRLFFunc findCRLF;
+    FindAnyOfFunc findAnyOf;
+    const char* name;
+};
+
+static ScanFuncs SelectScan() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return { FindCRLFAvx2, FindAnyOfAvx2, "avx2" };
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return { FindCRLFSse2, FindAnyOfSse2, "sse2" };
+    }
+#endif
+    return { FindCRLFScalar, FindAnyOfScalar, "scalar" };
+}
+
+static const ScanFuncs scan = SelectScan();
+
+const char* FindCRLF(const char* begin, const char* end) {
+    return scan.findCRLF(begin, end);
+}
+
+const char* FindAnyOf(const char* begin, const char* end, const char* chars, int n) {
+    return scan.findAnyOf(begin, end, chars, n);
+}
+
+const char* ScanImpl() {
+    return scan.name;
+}
@@ -0,0 +1,20 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+/*
+    请求数据中的分隔符查找
+    x86 上按 CPU 支持情况在启动时选择 AVX2 / SSE2 实现, 其他平台逐字节查找
+*/
+
+/* [begin, end) 中第一个 "\r\n" 的位置, 没有时返回 end */
+const char* FindCRLF(const char* begin, const char* end);
+
+/* [begin, end) 中第一个属于 chars 的字符位置(n 为 1~4), 没有时返回 end */
+const char* FindAnyOf(const char* begin, const char* end, const char* chars, int n);
+
+/* 当前使用的实现名, 用于启动日志 */
+const char* ScanImpl();
+
+#endif // HTTP_SCAN_H
@@ -0,0 +1,168 @@
+#ifndef HTTP_TABLES_H
+#define HTTP_TABLES_H
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+    编译期生成的状态行表和 MIME 表
+    组装响应头时只做一次查表和内存拷贝, 不再拼接 std::string
+*/
+
+/* ---------- 状态行: 以状态码为下标 ---------- */
+
+struct StatusText {
+    const char* line;       // "HTTP/1.1 200 OK\r\n"
+    size_t lineLen;
+    const char* reason;     // "OK"
+};
+
+#define STATUS_TEXT(code, reason) \
+    StatusText{ "HTTP/1.1 " #code " " reason "\r\n", sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1, reason }
+
+static constexpr int STATUS_MAX = 600;
+
+struct StatusTable {
+    StatusText text[STATUS_MAX];
+};
+
+static constexpr StatusTable MakeStatusTable() {
+    StatusTable t{};
+    t.text[100] = STATUS_TEXT(100, "Continue");
+    t.text[200] = STATUS_TEXT(200, "OK");
+    t.text[206] = STATUS_TEXT(206, "Partial Content");
+    t.text[304] = STATUS_TEXT(304, "Not Modified");
+    t.text[400] = STATUS_TEXT(400, "Bad Request");
+    t.text[403] = STATUS_TEXT(403, "Forbidden");
+    t.text[404] = STATUS_TEXT(404, "Not Found");
+    t.text[413] = STATUS_TEXT(413, "Payload Too Large");
+    t.text[414] = STATUS_TEXT(414, "URI Too Long");
+    t.text[416] = STATUS_TEXT(416, "Range Not Satisfiable");
+    t.text[431] = STATUS_TEXT(431, "Request Header Fields Too Large");
+    t.text[500] = STATUS_TEXT(500, "Internal Server Error");
+    return t;
+}
+
+static constexpr StatusTable STATUS_TABLE = MakeStatusTable();
+
+/* 不认识的状态码返回 nullptr */
+static inline const StatusText* FindStatus(int code) {
+    if(code < 0 || code >= STATUS_MAX || !STATUS_TABLE.text[code].line) {
+        return nullptr;
+    }
+    return &STATUS_TABLE.text[code];
+}
+
+/* ---------- MIME: 后缀的完美哈希 ---------- */
+
+struct MimeEntry {
+    const char* suffix;
+    size_t suffixLen;
+    const char* type;
+    size_t typeLen;
+};
+
+#define MIME_ENTRY(suffix, type) MimeEntry{ suffix, sizeof(suffix) - 1, type, sizeof(type) - 1 }
+
+static constexpr MimeEntry MIME_LIST[] = {
+    MIME_ENTRY(".html",  "text/html"),
+    MIME_ENTRY(".xml",   "text/xml"),
+    MIME_ENTRY(".xhtml", "application/xhtml+xml"),
+    MIME_ENTRY(".txt",   "text/plain"),
+    MIME_ENTRY(".rtf",   "application/rtf"),
+    MIME_ENTRY(".pdf",   "application/pdf"),
+    MIME_ENTRY(".word",  "application/nsword"),
+    MIME_ENTRY(".png",   "image/png"),
+    MIME_ENTRY(".gif",   "image/gif"),
+    MIME_ENTRY(".jpg",   "image/jpeg"),
+    MIME_ENTRY(".jpeg",  "image/jpeg"),
+    MIME_ENTRY(".ico",   "image/x-icon"),
+    MIME_ENTRY(".svg",   "image/svg+xml"),
+    MIME_ENTRY(".au",    "audio/basic"),
+    MIME_ENTRY(".mpeg",  "video/mpeg"),
+    MIME_ENTRY(".mpg",   "video/mpeg"),
+    MIME_ENTRY(".avi",   "video/x-msvideo"),
+    MIME_ENTRY(".mp4",   "video/mp4"),
+    MIME_ENTRY(".webm",  "video/webm"),
+    MIME_ENTRY(".gz",    "application/x-gzip"),
+    MIME_ENTRY(".tar",   "application/x-tar"),
+    MIME_ENTRY(".css",   "text/css"),
+    MIME_ENTRY(".js",    "text/javascript"),
+    MIME_ENTRY(".json",  "application/json"),
+    MIME_ENTRY(".woff",  "font/woff"),
+    MIME_ENTRY(".woff2", "font/woff2"),
+    MIME_ENTRY(".ttf",   "font/ttf"),
+    MIME_ENTRY(".otf",   "font/otf"),
+    MIME_ENTRY(".eot",   "application/vnd.ms-fontobject"),
+};
+
+static constexpr MimeEntry MIME_DEFAULT = MIME_ENTRY("", "text/plain");
+static constexpr size_t MIME_COUNT = sizeof(MIME_LIST) / sizeof(MIME_LIST[0]);
+static constexpr size_t MIME_SLOTS = 128;          // 2的幂
+static constexpr size_t MIME_SUFFIX_MAX = 8;
+
+/* FNV-1a, 忽略大小写 */
+static constexpr uint32_t SuffixHash(const char* s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for(size_t i = 0; i < len; i++) {
+        char ch = s[i];
+        if(ch >= 'A' && ch <= 'Z') { ch += 'a' - 'A'; }
+        h = (h ^ static_cast<uint8_t>(ch)) * 16777619u;
+    }
+    return h;
+}
+
+static constexpr bool MimeSeedIsPerfect(uint32_t seed) {
+    bool used[MIME_SLOTS] = {};
+    for(size_t i = 0; i < MIME_COUNT; i++) {
+        size_t slot = SuffixHash(MIME_LIST[i].suffix, MIME_LIST[i].suffixLen, seed) & (MIME_SLOTS - 1);
+        if(used[slot]) { return false; }
+        used[slot] = true;
+    }
+    return true;
+}
+
+/* 编译期找到第一个没有冲突的种子 */
+static constexpr uint32_t FindMimeSeed() {
+    uint32_t seed = 0;
+    while(!MimeSeedIsPerfect(seed)) { seed++; }
+    return seed;
+}
+
+static constexpr uint32_t MIME_SEED = FindMimeSeed();
+
+struct MimeTable {
+    int8_t slot[MIME_SLOTS];
+};
+
+static constexpr MimeTable MakeMimeTable() {
+    MimeTable t{};
+    for(size_t i = 0; i < MIME_SLOTS; i++) { t.slot[i] = -1; }
+    for(size_t i = 0; i < MIME_COUNT; i++) {
+        t.slot[SuffixHash(MIME_LIST[i].suffix, MIME_LIST[i].suffixLen, MIME_SEED) & (MIME_SLOTS - 1)] = i;
+    }
+    return t;
+}
+
+static constexpr MimeTable MIME_TABLE = MakeMimeTable();
+
+/* 按最后一个 '.' 之后的后缀查找, 找不到返回 text/plain */
+static inline const MimeEntry& FindMime(const char* path, size_t len) {
+    const char* dot = static_cast<const char*>(memrchr(path, '.', len));
+    if(!dot) {
+        return MIME_DEFAULT;
+    }
+    size_t suffixLen = path + len - dot;
+    if(suffixLen > MIME_SUFFIX_MAX) {
+        return MIME_DEFAULT;
+    }
+    int idx = MIME_TABLE.slot[SuffixHash(dot, suffixLen, MIME_SEED) & (MIME_SLOTS - 1)];
+    if(idx < 0 || MIME_LIST[idx].suffixLen != suffixLen
+        || strncasecmp(MIME_LIST[idx].suffix, dot, suffixLen) != 0) {
+        return MIME_DEFAULT;
+    }
+    return MIME_LIST[idx];
+}
+
+#endif // HTTP_TABLES_H
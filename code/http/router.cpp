@@ -0,0 +1,196 @@
+#include "router.h"
+using namespace std;
+
+Router::Router() {
+    nodes_.emplace_back();
+    AddDefaultRoutes_();
+}
+
+Router* Router::Instance() {
+    static Router router;
+    return &router;
+}
+
+void Router::AddDefaultRoutes_() {
+    AddStatic("/", "/index.html");
+    const char* pages[] = { "/index", "/register", "/login",
+                            "/welcome", "/video", "/picture", };
+    for(auto page: pages) {
+        AddStatic(page, string(page) + ".html");
+    }
+    /* 表单提交 */
+    for(auto path: { "/register", "/register.html" }) {
+        Add("POST", path, [](const HttpRequest& req, HttpResponse& resp) {
+            UserForm_(req, resp, false);
+        });
+    }
+    for(auto path: { "/login", "/login.html" }) {
+        Add("POST", path, [](const HttpRequest& req, HttpResponse& resp) {
+            UserForm_(req, resp, true);
+        });
+    }
+}
+
+void Router::Add(const string& method, const string& path, const RouteHandler& handler) {
+    AddStream(method, path, nullptr, handler);
+}
+
+void Router::AddStream(const string& method, const string& path,
+                       const BodyRoute& body, const RouteHandler& handler) {
+    assert(method != "" && path != "" && handler);
+    int node = Insert_(method, path);
+    if(nodes_[node].route < 0) {
+        nodes_[node].route = routes_.size();
+        routes_.push_back({ handler, body });
+    } else {
+        routes_[nodes_[node].route] = { handler, body };
+    }
+}
+
+void Router::AddStatic(const string& path, const string& target) {
+    Add("*", path, [target](const HttpRequest&, HttpResponse& resp) {
+        resp.SetPath(target);
+    });
+}
+
+bool Router::Dispatch(const HttpRequest& req, HttpResponse& resp) const {
+    int route = Match_(req);
+    if(route < 0) {
+        return false;
+    }
+    routes_[route].handler(req, resp);
+    return true;
+}
+
+BodyHandler Router::BodyHandlerFor(const HttpRequest& req) const {
+    int route = Match_(req);
+    if(route < 0 || !routes_[route].body) {
+        return nullptr;
+    }
+    return routes_[route].body(req);
+}
+
+int Router::Match_(const HttpRequest& req) const {
+    int route = Find_(req.method(), req.path());
+    if(route < 0) {
+        route = Find_("*", req.path());
+    }
+    return route;
+}
+
+int Router::Insert_(const string& method, const string& path) {
+    int node = 0;
+    string key = method + " " + path;
+    for(char ch: key) {
+        int next = Child_(node, ch);
+        if(next < 0) {
+            next = nodes_.size();
+            nodes_.emplace_back();
+            auto& edges = nodes_[node].next;
+            auto it = lower_bound(edges.begin(), edges.end(), make_pair(ch, 0));
+            edges.insert(it, make_pair(ch, next));
+        }
+        node = next;
+    }
+    return node;
+}
+
+int Router::Find_(const string& method, const string& path) const {
+    int node = Walk_(0, method);
+    if(node < 0 || (node = Child_(node, ' ')) < 0) {
+        return -1;
+    }
+    node = Walk_(node, path);
+    return node < 0 ? -1 : nodes_[node].route;
+}
+
+int Router::Walk_(int node, const string& str) const {
+    for(char ch: str) {
+        node = Child_(node, ch);
+        if(node < 0) { break; }
+    }
+    return node;
+}
+
+int Router::Child_(int node, char ch) const {
+    /* 每个结点的出边很少, 顺序扫描比二分更快 */
+    for(auto& edge: nodes_[node].next) {
+        if(edge.first == ch) { return edge.second; }
+        if(edge.first > ch) { break; }
+    }
+    return -1;
+}
+
+void Router::UserForm_(const HttpRequest& req, HttpResponse& resp, bool isLogin) {
+    /* 不是表单提交时按原页面返回 */
+    resp.SetPath(isLogin ? "/login.html" : "/register.html");
+    if(req.GetHeader("Content-Type") != "application/x-www-form-urlencoded") {
+        return;
+    }
+    LOG_DEBUG("Tag:%d", isLogin);
+    if(UserVerify_(req.GetPost("username"), req.GetPost("password"), isLogin)) {
+        resp.SetPath("/welcome.html");
+    }
+    else {
+        resp.SetPath("/error.html");
+    }
+}
+
+bool Router::UserVerify_(const string &name, const string &pwd, bool isLogin) {
+    if(name == "" || pwd == "") { return false; }
+    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    MYSQL* sql;
+    /* 等待连接池和执行查询分开记录 */
+    TraceSpan connSpan("db.conn");
+    SqlConnRAII raii(&sql, SqlConnPool::Instance());
+    assert(sql);
+    connSpan.End();
+    TraceSpan querySpan("db.query");
+
+    bool flag = false;
+    char order[256] = { 0 };
+    MYSQL_RES *res = nullptr;
+
+    if(!isLogin) { flag = true; }
+    /* 查询用户及密码 */
+    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
+    LOG_DEBUG("%s", order);
+
+    if(mysql_query(sql, order)) {
+        mysql_free_result(res);
+        return false;
+    }
+    res = mysql_store_result(sql);
+
+    while(MYSQL_ROW row = mysql_fetch_row(res)) {
+        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
+        string password(row[1]);
+        /* 注册行为 且 用户名未被使用*/
+        if(isLogin) {
+            if(pwd == password) { flag = true; }
+            else {
+                flag = false;
+                LOG_DEBUG("pwd error!");
+            }
+        }
+        else {
+            flag = false;
+            LOG_DEBUG("user used!");
+        }
+    }
+    mysql_free_result(res);
+
+    /* 注册行为 且 用户名未被使用*/
+    if(!isLogin && flag == true) {
+        LOG_DEBUG("regirster!");
+        bzero(order, 256);
+        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
+        LOG_DEBUG( "%s", order);
+        if(mysql_query(sql, order)) {
+            LOG_DEBUG( "Insert error!");
+            flag = false;
+        }
+    }
+    LOG_DEBUG( "UserVerify success!!");
+    return flag;
+}
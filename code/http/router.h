@@ -0,0 +1,73 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include "../log/log.h"
+#include "../pool/sqlconnpool.h"
+#include "../pool/sqlconnRAll.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "../metrics/trace.h"
+
+typedef std::function<void(const HttpRequest&, HttpResponse&)> RouteHandler;
+/* 每个请求创建一个 BodyHandler, 可在其中保存该请求的上传状态 */
+typedef std::function<BodyHandler(const HttpRequest&)> BodyRoute;
+
+/*
+    路由表: method + path -> handler
+    路由在启动时注册, 之后只读, 工作线程无锁查找
+    用字典树组织, 查找代价只和 method/path 的长度有关, 与路由数量无关
+    请求解析完成后才分发, 解析阶段不再做任何业务判断
+*/
+class Router {
+public:
+    static Router* Instance();
+
+    /* method 为 "*" 时匹配任意方法 */
+    void Add(const std::string& method, const std::string& path, const RouteHandler& handler);
+    /* 静态页面别名, 例如 /login -> /login.html */
+    void AddStatic(const std::string& path, const std::string& target);
+    /* 请求体不缓存, 边读边交给 body 返回的 BodyHandler, 读完后再调用 handler */
+    void AddStream(const std::string& method, const std::string& path,
+                   const BodyRoute& body, const RouteHandler& handler);
+
+    /* 请求头解析完成后调用, 没有流式路由时返回空 */
+    BodyHandler BodyHandlerFor(const HttpRequest& req) const;
+
+    /* 没有匹配的路由时返回false, 按静态文件处理 */
+    bool Dispatch(const HttpRequest& req, HttpResponse& resp) const;
+
+private:
+    Router();
+    ~Router() = default;
+
+    struct Route {
+        RouteHandler handler;
+        BodyRoute body;
+    };
+
+    struct TrieNode {
+        std::vector<std::pair<char, int>> next;  // 按字符有序
+        int route = -1;
+    };
+
+    int Insert_(const std::string& method, const std::string& path);
+    int Find_(const std::string& method, const std::string& path) const;
+    int Match_(const HttpRequest& req) const;
+    int Child_(int node, char ch) const;
+    int Walk_(int node, const std::string& str) const;
+
+    void AddDefaultRoutes_();
+    static void UserForm_(const HttpRequest& req, HttpResponse& resp, bool isLogin);
+    static bool UserVerify_(const std::string& name, const std::string& pwd, bool isLogin);
+
+    std::vector<TrieNode> nodes_;
+    std::vector<Route> routes_;
+};
+
+#endif // ROUTER_H
@@ -148,10 +148,11 @@ template<class T>
 bool BlockDeque<T>::pop(T &item) {
     std::unique_lock<std::mutex> locker(mtx_);
     while(deq_.empty()){
-        condConsumer_.wait(locker);
+        /* 先检查再等待, Close 的通知发生在消费者等待之前时也能返回 */
         if(isClose_){
             return false;
         }
+        condConsumer_.wait(locker);
     }
     item = deq_.front();
     deq_.pop_front();
@@ -12,13 +12,7 @@ Log::Log() {
 }
 
 Log::~Log() {
-    if(writeThread_ && writeThread_->joinable()) {
-        while(!deque_->empty()) {
-            deque_->flush();
-        };
-        deque_->Close();
-        writeThread_->join();
-    }
+    StopAsync();
     if(fp_) {
         lock_guard<mutex> locker(mtx_);
         flush();
@@ -73,10 +67,10 @@ void Log::init(int level = 1, const char* path, const char* suffix,
             fclose(fp_); 
         }
 
-        fp_ = fopen(fileName, "a");
+        fp_ = fopen(fileName, "ae");
         if(fp_ == nullptr) {
             mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");
+            fp_ = fopen(fileName, "ae");
         } 
         assert(fp_ != nullptr);
     }
@@ -113,7 +107,7 @@ void Log::write(int level, const char *format, ...) {
         locker.lock();
         flush();
         fclose(fp_);
-        fp_ = fopen(newFile, "a");
+        fp_ = fopen(newFile, "ae");
         assert(fp_ != nullptr);
     }
 
@@ -170,6 +164,25 @@ void Log::flush() {
     fflush(fp_);
 }
 
+void Log::StopAsync() {
+    if(!writeThread_ || !writeThread_->joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> locker(mtx_);
+        isAsync_ = false;
+    }
+    while(!deque_->empty()) {
+        deque_->flush();
+        this_thread::yield();
+    }
+    deque_->Close();
+    writeThread_->join();
+    writeThread_.reset();
+    lock_guard<mutex> locker(mtx_);
+    if(fp_) { fflush(fp_); }
+}
+
 void Log::AsyncWrite_() {
     string str = "";
     while(deque_->pop(str)) {
@@ -27,6 +27,8 @@ public:
 
     void write(int level, const char *format,...);
     void flush();
+    /* 写完异步队列中的日志并结束写线程, 之后的日志直接写文件 */
+    void StopAsync();
 
     int GetLevel();
     void SetLevel(int level);
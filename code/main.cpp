@@ -1,14 +1,38 @@
 #include <unistd.h>
+#include <memory>
+#include "config/config.h"
 #include "server/webserver.h"
 
-int main() {
-    /* 守护进程 后台运行 */
-    //daemon(1, 0); 
+int main(int argc, char* argv[]) {
+    /* 默认值 <- -c 指定的配置文件 <- 命令行 --key=value */
+    std::unique_ptr<Config> config(new Config());
+    if(!config->Parse(argc, argv)) {
+        fprintf(stderr, "Try '%s --help' for the list of options.\n", argv[0]);
+        return 1;
+    }
+    config->Apply();
+
+    /* 守护进程 后台运行; 平滑升级启动的新进程由旧进程等待, 不再 fork */
+    if(config->daemonize && !getenv("WEBSERVER_LISTEN_FD") && daemon(1, 0) < 0) {
+        perror("daemon");
+        return 1;
+    }
 
     WebServer server(
-        5678, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
-        3306, "root", "123456", "webdb", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        config->port, config->trigMode, config->timeoutMS, config->optLinger,   /* 端口 ET模式 timeoutMs 优雅退出  */
+        config->sqlPort, config->sqlUser.c_str(), config->sqlPwd.c_str(), config->dbName.c_str(), /* Mysql配置 */
+        config->connPoolNum, config->threadNum,                                 /* 连接池数量 线程池数量 */
+        config->openLog, config->logLevel, config->logQueSize,                  /* 日志开关 日志等级 日志异步队列容量 */
+        config->bundlePath.empty() ? nullptr : config->bundlePath.c_str());     /* 静态资源包(make bundle 生成) */
+
+    /* SIGHUP: 在主线程重新解析同样的命令行和配置文件, 没有出现的键沿用当前值 */
+    server.OnReload([&config, argc, argv](WebServer& s) {
+        std::unique_ptr<Config> fresh(new Config());
+        fresh->CopyValues(*config);
+        if(!fresh->Parse(argc, argv)) { return false; }
+        fresh->Reload(*config, s);
+        config = std::move(fresh);
+        return true;
+    });
     server.Start();
-} 
-  
\ No newline at end of file
+}
@@ -0,0 +1,185 @@
+#include "metrics.h"
+using namespace std;
+
+static void AppendFormat(string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void AppendFormat(string& out, const char* format, ...) {
+    char line[256];
+    va_list vaList;
+    va_start(vaList, format);
+    int n = vsnprintf(line, sizeof(line), format, vaList);
+    va_end(vaList);
+    if(n > 0) { out.append(line, min(n, static_cast<int>(sizeof(line)) - 1)); }
+}
+
+LatencyHistogram::LatencyHistogram() : sum(0) {
+    for(auto& count: counts) {
+        count.store(0, memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::Record(uint64_t ns) {
+    auto& count = counts[Bucket(ns)];
+    count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    sum.store(sum.load(memory_order_relaxed) + ns, memory_order_relaxed);
+}
+
+int LatencyHistogram::Bucket(uint64_t ns) {
+    if(ns < SUB_COUNT) {
+        return static_cast<int>(ns);
+    }
+    if(ns >= (1ULL << MAX_BITS)) {
+        return BUCKETS - 1;
+    }
+    /* 最高位决定所在的段, 紧随其后的 SUB_BITS 位决定段内的桶 */
+    int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + static_cast<int>((ns >> shift) - SUB_COUNT);
+}
+
+uint64_t LatencyHistogram::BucketUpper(int bucket) {
+    if(bucket < SUB_COUNT) {
+        return bucket + 1;
+    }
+    int shift = bucket / SUB_COUNT - 1;
+    uint64_t sub = bucket % SUB_COUNT;
+    return (SUB_COUNT + sub + 1) << shift;
+}
+
+Metrics::Shard::Shard() {
+    for(auto& counter: counters) {
+        counter.store(0, memory_order_relaxed);
+    }
+    for(auto& count: status) {
+        count.store(0, memory_order_relaxed);
+    }
+}
+
+Metrics* Metrics::Instance() {
+    static Metrics metrics;
+    return &metrics;
+}
+
+Metrics::Shard* Metrics::Register_() {
+    lock_guard<mutex> locker(mtx_);
+    shards_.emplace_back(new Shard());
+    return shards_.back().get();
+}
+
+void Metrics::AddGauge(const string& name, const string& help, const function<double()>& value) {
+    lock_guard<mutex> locker(mtx_);
+    gauges_.push_back({ name, help, value });
+}
+
+void Metrics::Export(string& out) {
+    static const char* const COUNTER_INFO[COUNTER_NUM][2] = {
+        { "accepts_total",              "Accepted connections." },
+        { "rejects_total",              "Connections rejected because the connection table is full." },
+        { "read_bytes_total",           "Bytes read from clients." },
+        { "written_bytes_total",        "Bytes written to clients." },
+        { "tasks_queued_total",         "Tasks submitted to the worker pool." },
+        { "tasks_started_total",        "Tasks started by worker threads." },
+        { "bundle_hits_total",          "Files served from the resource bundle." },
+        { "gzip_cache_hits_total",      "On-the-fly gzip responses served from the cache." },
+        { "gzip_cache_misses_total",    "On-the-fly gzip responses compressed on demand." },
+        { "cold_reads_total",           "Files handed to the read threads because they were not cached." },
+    };
+    static const char* const STAGE_NAME[STAGE_NUM] = { "parse", "build", "write" };
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    /* 分片在锁内求和, 锁只挡住新线程登记, 不影响记录 */
+    vector<uint64_t> counters(COUNTER_NUM), status(MAX_STATUS - MIN_STATUS + 1);
+    vector<vector<uint64_t>> latency(STAGE_NUM, vector<uint64_t>(LatencyHistogram::BUCKETS));
+    vector<uint64_t> latencySum(STAGE_NUM);
+    vector<Gauge> gauges;
+    {
+        lock_guard<mutex> locker(mtx_);
+        for(auto& shard: shards_) {
+            for(int i = 0; i < COUNTER_NUM; i++) {
+                counters[i] += shard->counters[i].load(memory_order_relaxed);
+            }
+            for(size_t i = 0; i < status.size(); i++) {
+                status[i] += shard->status[i].load(memory_order_relaxed);
+            }
+            for(int i = 0; i < STAGE_NUM; i++) {
+                for(int j = 0; j < LatencyHistogram::BUCKETS; j++) {
+                    latency[i][j] += shard->latency[i].counts[j].load(memory_order_relaxed);
+                }
+                latencySum[i] += shard->latency[i].sum.load(memory_order_relaxed);
+            }
+        }
+        gauges = gauges_;
+    }
+
+    for(int i = 0; i < COUNTER_NUM; i++) {
+        AppendFormat(out, "# HELP webserver_%s %s\n", COUNTER_INFO[i][0], COUNTER_INFO[i][1]);
+        AppendFormat(out, "# TYPE webserver_%s counter\n", COUNTER_INFO[i][0]);
+        AppendFormat(out, "webserver_%s %llu\n", COUNTER_INFO[i][0], (unsigned long long)counters[i]);
+    }
+
+    out += "# HELP webserver_requests_total Responses by status code.\n";
+    out += "# TYPE webserver_requests_total counter\n";
+    for(size_t i = 0; i < status.size(); i++) {
+        if(status[i] == 0) { continue; }
+        AppendFormat(out, "webserver_requests_total{code=\"%d\"} %llu\n",
+                     static_cast<int>(i) + MIN_STATUS, (unsigned long long)status[i]);
+    }
+
+    /* 两个计数分别读取, 可能短暂地出现开始数大于提交数 */
+    uint64_t queued = counters[TASKS_QUEUED], started = counters[TASKS_STARTED];
+    out += "# HELP webserver_task_queue_depth Tasks waiting for a worker thread.\n";
+    out += "# TYPE webserver_task_queue_depth gauge\n";
+    AppendFormat(out, "webserver_task_queue_depth %llu\n",
+                 (unsigned long long)(queued > started ? queued - started : 0));
+
+    for(auto& gauge: gauges) {
+        AppendFormat(out, "# HELP webserver_%s %s\n", gauge.name.c_str(), gauge.help.c_str());
+        AppendFormat(out, "# TYPE webserver_%s gauge\n", gauge.name.c_str());
+        AppendFormat(out, "webserver_%s %.17g\n", gauge.name.c_str(), gauge.value());
+    }
+
+    out += "# HELP webserver_stage_seconds Time spent in each request stage.\n";
+    out += "# TYPE webserver_stage_seconds histogram\n";
+    for(int i = 0; i < STAGE_NUM; i++) {
+        ExportHistogram_(out, STAGE_NAME[i], latency[i], latencySum[i]);
+    }
+
+    /* 分位数由细分的桶计算, 误差不超过 1 / SUB_COUNT */
+    out += "# HELP webserver_stage_quantile_seconds Latency quantiles of each request stage.\n";
+    out += "# TYPE webserver_stage_quantile_seconds gauge\n";
+    for(int i = 0; i < STAGE_NUM; i++) {
+        uint64_t total = 0;
+        for(uint64_t count: latency[i]) { total += count; }
+        if(total == 0) { continue; }
+        for(double q: QUANTILES) {
+            uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(q * total)));
+            uint64_t seen = 0;
+            int bucket = 0;
+            for(; bucket < LatencyHistogram::BUCKETS - 1; bucket++) {
+                seen += latency[i][bucket];
+                if(seen >= rank) { break; }
+            }
+            uint64_t lower = bucket == 0 ? 0 : LatencyHistogram::BucketUpper(bucket - 1);
+            uint64_t upper = LatencyHistogram::BucketUpper(bucket);
+            AppendFormat(out, "webserver_stage_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %.9g\n",
+                         STAGE_NAME[i], q, (lower + upper) / 2 / 1e9);
+        }
+    }
+}
+
+void Metrics::ExportHistogram_(string& out, const char* stage, const vector<uint64_t>& counts, uint64_t sum) {
+    /* 对外只给 2 的幂处的累计值(从约 1us 起), 桶边界固定, 多个实例可以直接相加 */
+    const uint64_t minBound = 1ULL << 10;
+    uint64_t total = 0;
+    for(int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        total += counts[i];
+        uint64_t upper = LatencyHistogram::BucketUpper(i);
+        if(upper >= minBound && upper < (1ULL << LatencyHistogram::MAX_BITS) && (upper & (upper - 1)) == 0) {
+            AppendFormat(out, "webserver_stage_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %llu\n",
+                         stage, upper / 1e9, (unsigned long long)total);
+        }
+    }
+    AppendFormat(out, "webserver_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                 stage, (unsigned long long)total);
+    AppendFormat(out, "webserver_stage_seconds_sum{stage=\"%s\"} %.9g\n", stage, sum / 1e9);
+    AppendFormat(out, "webserver_stage_seconds_count{stage=\"%s\"} %llu\n", stage, (unsigned long long)total);
+}
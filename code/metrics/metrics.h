@@ -0,0 +1,135 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+/*
+    延迟直方图(HDR 风格的对数线性分桶): 以 2 的幂分段, 每段再等分为 SUB_COUNT 个桶
+    相对误差不超过 1 / SUB_COUNT, 记录只是一次下标计算和一次加法
+    每个直方图只由所属线程写入, 读取方可以并发地取近似一致的快照
+*/
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 3;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_BITS = 36;     // 以纳秒计, 上限约 68 秒, 超出的记在最后一个桶
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    LatencyHistogram();
+
+    void Record(uint64_t ns);
+
+    static int Bucket(uint64_t ns);
+    /* 桶的上界(不含) */
+    static uint64_t BucketUpper(int bucket);
+
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> sum;          // 纳秒
+};
+
+/*
+    运行指标: 每个线程写自己的分片, 只有本线程写入, 不加锁也没有原子读改写
+    抓取时把所有分片相加, 输出 Prometheus 文本格式
+    分片在线程第一次记录时登记, 线程退出后保留, 计数不会丢失
+*/
+class Metrics {
+public:
+    enum Counter {
+        ACCEPTS,            // 接受的连接
+        REJECTS,            // 连接表已满被拒绝的连接
+        BYTES_READ,
+        BYTES_WRITTEN,
+        TASKS_QUEUED,       // 提交给工作线程池的任务
+        TASKS_STARTED,      // 工作线程开始执行的任务, 与上一项之差即队列长度
+        BUNDLE_HITS,        // 从资源包返回的文件
+        GZIP_CACHE_HITS,    // 即时压缩命中缓存
+        GZIP_CACHE_MISSES,  // 即时压缩未命中, 当场压缩
+        COLD_READS,         // 交给读线程的冷文件
+        COUNTER_NUM
+    };
+
+    enum Stage {
+        PARSE,              // 解析请求
+        BUILD,              // 路由, 生成响应头, 打开文件
+        WRITE,              // 响应就绪到最后一个字节写入套接字
+        STAGE_NUM
+    };
+
+    static Metrics* Instance();
+
+    static void Add(Counter counter, uint64_t n = 1) {
+        Bump_(Local_()->counters[counter], n);
+    }
+
+    static void AddStatus(int code) {
+        if(code < MIN_STATUS || code > MAX_STATUS) { return; }
+        Bump_(Local_()->status[code - MIN_STATUS], 1);
+    }
+
+    static void Record(Stage stage, uint64_t ns) {
+        Local_()->latency[stage].Record(ns);
+    }
+
+    /* 单调时钟, 纳秒 */
+    static uint64_t Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    /* 抓取时才求值的瞬时量, 启动时注册 */
+    void AddGauge(const std::string& name, const std::string& help, const std::function<double()>& value);
+
+    /* 汇总所有分片, 按 Prometheus 文本格式追加到 out */
+    void Export(std::string& out);
+
+private:
+    static const int MIN_STATUS = 100;
+    static const int MAX_STATUS = 599;
+
+    struct Shard {
+        Shard();
+        std::atomic<uint64_t> counters[COUNTER_NUM];
+        std::atomic<uint64_t> status[MAX_STATUS - MIN_STATUS + 1];
+        LatencyHistogram latency[STAGE_NUM];
+    };
+
+    struct Gauge {
+        std::string name;
+        std::string help;
+        std::function<double()> value;
+    };
+
+    Metrics() = default;
+    ~Metrics() = default;
+
+    /* 只有一个写者, load + store 即可, 不需要 lock 前缀的 fetch_add */
+    static void Bump_(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static Shard* Local_() {
+        static thread_local Shard* shard = Instance()->Register_();
+        return shard;
+    }
+
+    Shard* Register_();
+    static void ExportHistogram_(std::string& out, const char* stage, const std::vector<uint64_t>& counts, uint64_t sum);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<Gauge> gauges_;
+    std::mutex mtx_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,112 @@
+#include "trace.h"
+using namespace std;
+
+atomic<int> Tracer::sampleEvery(0);
+thread_local uint64_t Tracer::current_ = 0;
+
+Tracer::Tracer() : requests_(0), nextId_(1) {}
+
+Tracer* Tracer::Instance() {
+    static Tracer tracer;
+    return &tracer;
+}
+
+uint64_t Tracer::Sample() {
+    int every = sampleEvery;
+    if(every <= 0) {
+        return 0;
+    }
+    /* 按请求计数等间隔采样, 不同线程并发调用也不会漏采或重复 */
+    if(requests_.fetch_add(1, memory_order_relaxed) % every != 0) {
+        return 0;
+    }
+    return nextId_.fetch_add(1, memory_order_relaxed);
+}
+
+Tracer::Ring* Tracer::Local_() {
+    static thread_local Ring* ring = Instance()->Register_();
+    return ring;
+}
+
+Tracer::Ring* Tracer::Register_() {
+    /* 只有记录过 span 的线程才分配缓冲区 */
+    unique_ptr<Ring> ring(new Ring());
+    ring->tid = static_cast<int>(syscall(SYS_gettid));
+    ring->writing.store(0, memory_order_relaxed);
+    ring->head.store(0, memory_order_relaxed);
+    lock_guard<mutex> locker(mtx_);
+    rings_.push_back(move(ring));
+    return rings_.back().get();
+}
+
+void Tracer::Record(uint64_t id, const char* name, uint64_t start, uint64_t end) {
+    Ring* ring = Local_();
+    uint64_t index = ring->head.load(memory_order_relaxed);
+    Span& span = ring->spans[index & (RING_SIZE - 1)];
+    ring->writing.store(index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    span.id.store(id, memory_order_relaxed);
+    span.start.store(start, memory_order_relaxed);
+    span.dur.store(end > start ? end - start : 0, memory_order_relaxed);
+    span.name.store(name, memory_order_relaxed);
+    ring->head.store(index + 1, memory_order_release);
+}
+
+void Tracer::Collect_(Ring* ring, vector<Event>& events) {
+    uint64_t head = ring->head.load(memory_order_acquire);
+    uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+    size_t begin = events.size();
+    for(uint64_t i = first; i < head; i++) {
+        Span& span = ring->spans[i & (RING_SIZE - 1)];
+        events.push_back({ ring->tid, span.id.load(memory_order_relaxed),
+                           span.start.load(memory_order_relaxed), span.dur.load(memory_order_relaxed),
+                           span.name.load(memory_order_relaxed) });
+    }
+    /* 复制期间写线程开始覆盖的槽位可能不完整, 连同更旧的记录一起丢弃 */
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t writing = ring->writing.load(memory_order_relaxed);
+    uint64_t valid = writing > RING_SIZE ? writing - RING_SIZE : 0;
+    if(valid > first) {
+        size_t drop = min<uint64_t>(valid - first, head - first);
+        events.erase(events.begin() + begin, events.begin() + begin + drop);
+    }
+}
+
+int Tracer::Dump(const char* path) {
+    vector<Event> events;
+    vector<int> tids;
+    {
+        lock_guard<mutex> locker(mtx_);
+        for(auto& ring: rings_) {
+            Collect_(ring.get(), events);
+            tids.push_back(ring->tid);
+        }
+    }
+    /* 先写临时文件再改名, 读取方不会看到写了一半的文件 */
+    string tmp = string(path) + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "w");
+    if(!fp) {
+        return -1;
+    }
+    int pid = getpid();
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"webserver\"}}", pid);
+    for(int tid: tids) {
+        /* 主线程的 tid 等于 pid */
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s-%d\"}}",
+                pid, tid, tid == pid ? "reactor" : "thread", tid);
+    }
+    for(auto& event: events) {
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,\"args\":{\"trace\":%llu}}",
+                event.name, event.start / 1e3, event.dur / 1e3, pid, event.tid, (unsigned long long)event.id);
+    }
+    fprintf(fp, "\n]}\n");
+    bool ok = !ferror(fp);
+    ok = fclose(fp) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path) < 0) {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return static_cast<int>(events.size());
+}
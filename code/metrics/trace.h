@@ -0,0 +1,110 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "metrics.h"
+
+/*
+    请求追踪: 每 sampleEvery 个请求采样一个, 给它分配追踪 id
+    各阶段的耗时记为 span, 写入当前线程的环形缓冲区, 写满后覆盖最旧的记录
+    导出时汇总所有线程, 生成 Chrome trace-event JSON (chrome://tracing 或 Perfetto 打开)
+    没有采样的请求只多一次线程局部变量的判断
+*/
+class Tracer {
+public:
+    static Tracer* Instance();
+
+    /* 每个请求调用一次: 采样时返回新的追踪 id, 否则返回 0 */
+    uint64_t Sample();
+
+    /* 工作线程开始处理某个连接前设置, 之后本线程的 span 都归到这个请求 */
+    static void SetCurrent(uint64_t id) { current_ = id; }
+    static uint64_t Current() { return current_; }
+
+    /* name 必须是字符串常量, 环形缓冲区只保存指针 */
+    static void Record(uint64_t id, const char* name, uint64_t start, uint64_t end);
+    static void Record(const char* name, uint64_t start, uint64_t end) {
+        if(current_) { Record(current_, name, start, end); }
+    }
+
+    /* 写出 Chrome trace-event JSON, 返回写出的 span 数, 失败时返回 -1 */
+    int Dump(const char* path);
+
+    static std::atomic<int> sampleEvery;    // 0 表示不追踪
+
+private:
+    static const size_t RING_SIZE = 4096;   // 每个线程保留的 span 数, 2 的幂
+
+    struct Span {
+        std::atomic<uint64_t> id;
+        std::atomic<uint64_t> start;        // 单调时钟, 纳秒
+        std::atomic<uint64_t> dur;
+        std::atomic<const char*> name;
+    };
+
+    /*
+        只有所属线程写入, 用两个计数做无锁的一致性检查:
+        写一条之前先推进 writing, 写完再推进 head
+        读取方按 head 复制, 再看 writing, 已被覆盖的记录丢弃
+    */
+    struct Ring {
+        int tid;
+        std::atomic<uint64_t> writing;
+        std::atomic<uint64_t> head;
+        Span spans[RING_SIZE];
+    };
+
+    struct Event {
+        int tid;
+        uint64_t id;
+        uint64_t start;
+        uint64_t dur;
+        const char* name;
+    };
+
+    Tracer();
+    ~Tracer() = default;
+
+    static Ring* Local_();
+    Ring* Register_();
+    static void Collect_(Ring* ring, std::vector<Event>& events);
+
+    static thread_local uint64_t current_;
+
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> nextId_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::mutex mtx_;
+};
+
+/* 作用域内的一个阶段: 当前线程正在处理采样的请求时, 析构或 End 时记录 */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : name_(name), id_(Tracer::Current()), start_(id_ ? Metrics::Now() : 0) {}
+    ~TraceSpan() { End(); }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void End() {
+        if(id_) {
+            Tracer::Record(id_, name_, start_, Metrics::Now());
+            id_ = 0;
+        }
+    }
+
+private:
+    const char* name_;
+    uint64_t id_;
+    uint64_t start_;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,86 @@
+#include "compresscache.h"
+using namespace std;
+
+CompressCache::CompressCache() : capacity_(64 * 1024 * 1024), used_(0) {}
+
+CompressCache* CompressCache::Instance() {
+    static CompressCache cache;
+    return &cache;
+}
+
+size_t CompressCache::Capacity() {
+    lock_guard<mutex> locker(mtx_);
+    return capacity_;
+}
+
+void CompressCache::SetCapacity(size_t bytes) {
+    lock_guard<mutex> locker(mtx_);
+    capacity_ = bytes;
+    Evict_();
+}
+
+shared_ptr<const string> CompressCache::Get(const string& key, time_t mtime, off_t size) {
+    lock_guard<mutex> locker(mtx_);
+    auto it = map_.find(key);
+    if(it == map_.end()) {
+        return nullptr;
+    }
+    if(it->second.mtime != mtime || it->second.size != size) {
+        /* 文件已修改 */
+        used_ -= it->second.data->size();
+        lru_.erase(it->second.lru);
+        map_.erase(it);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.data;
+}
+
+void CompressCache::Put(const string& key, time_t mtime, off_t size,
+                        const shared_ptr<const string>& data) {
+    assert(data);
+    lock_guard<mutex> locker(mtx_);
+    if(data->size() > capacity_) {
+        return;
+    }
+    auto it = map_.find(key);
+    if(it != map_.end()) {
+        used_ -= it->second.data->size();
+        lru_.erase(it->second.lru);
+        map_.erase(it);
+    }
+    lru_.push_front(key);
+    map_[key] = { mtime, size, data, lru_.begin() };
+    used_ += data->size();
+    Evict_();
+}
+
+void CompressCache::Evict_() {
+    while(used_ > capacity_ && !lru_.empty()) {
+        auto it = map_.find(lru_.back());
+        used_ -= it->second.data->size();
+        map_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+bool CompressCache::Gzip(const char* data, size_t len, string& out, int level) {
+    z_stream zs = { 0 };
+    /* windowBits 加16 输出gzip格式 */
+    if(deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, len));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = len;
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if(ret != Z_STREAM_END) {
+        LOG_WARN("gzip failed: %d", ret);
+        return false;
+    }
+    return true;
+}
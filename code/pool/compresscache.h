@@ -0,0 +1,53 @@
+#ifndef COMPRESSCACHE_H
+#define COMPRESSCACHE_H
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/types.h>
+#include <time.h>
+#include <zlib.h>
+#include "../log/log.h"
+
+/*
+    压缩结果缓存: 路径 -> gzip后的内容
+    以修改时间和大小校验, 文件变化后旧内容自动失效
+    按字节数限制容量, 超出时淘汰最久未使用的条目
+    返回 shared_ptr, 正在发送的内容被淘汰也不会失效
+*/
+class CompressCache {
+public:
+    static CompressCache* Instance();
+
+    void SetCapacity(size_t bytes);
+    size_t Capacity();
+
+    std::shared_ptr<const std::string> Get(const std::string& key, time_t mtime, off_t size);
+    void Put(const std::string& key, time_t mtime, off_t size,
+             const std::shared_ptr<const std::string>& data);
+
+    static bool Gzip(const char* data, size_t len, std::string& out, int level = 6);
+
+private:
+    CompressCache();
+    ~CompressCache() = default;
+
+    struct Entry {
+        time_t mtime;
+        off_t size;
+        std::shared_ptr<const std::string> data;
+        std::list<std::string>::iterator lru;
+    };
+
+    void Evict_();
+
+    size_t capacity_;
+    size_t used_;
+    std::list<std::string> lru_;    // 表头为最近使用
+    std::unordered_map<std::string, Entry> map_;
+    std::mutex mtx_;
+};
+
+#endif // COMPRESSCACHE_H
@@ -0,0 +1,132 @@
+#include "filereader.h"
+using namespace std;
+
+FileRead::FileRead(FileReader* reader, int fd, off_t offset, size_t len, char* block)
+    : reader_(reader), fd_(fd), offset_(offset), left_(len), block_(block), len_(0),
+      state_(IDLE), cancelled_(false) {}
+
+FileRead::~FileRead() {
+    close(fd_);
+    reader_->Free_(block_);
+}
+
+ssize_t FileRead::Take(const function<void()>& ready) {
+    lock_guard<mutex> locker(mtx_);
+    assert(state_ != IDLE);
+    if(state_ == READING) {
+        ready_ = ready;
+        return 0;
+    }
+    state_ = IDLE;
+    /* 文件在发送途中被截断时读到 0 字节, 按错误处理 */
+    return len_ == 0 ? -EIO : len_;
+}
+
+bool FileRead::Next() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(state_ != IDLE) { return true; }
+        if(left_ == 0) { return false; }
+        state_ = READING;
+    }
+    reader_->Submit_(self_.lock());
+    return true;
+}
+
+void FileRead::Cancel() {
+    lock_guard<mutex> locker(mtx_);
+    cancelled_ = true;
+    ready_ = nullptr;
+}
+
+void FileRead::Done_(ssize_t len) {
+    lock_guard<mutex> locker(mtx_);
+    len_ = len;
+    state_ = READY;
+    /* 持锁回调, Cancel 返回后连接的 fd 才会关闭, 不会通知到复用这个 fd 的新连接 */
+    if(ready_ && !cancelled_) {
+        auto ready = move(ready_);
+        ready_ = nullptr;
+        ready();
+    }
+}
+
+FileReader::FileReader() : blockSize_(0), maxBlocks_(0), blockCount_(0) {}
+
+FileReader::~FileReader() {
+    /* 先等读线程结束, 正在执行的读任务会把缓冲块还回来 */
+    pool_.reset();
+    for(char* block: freeBlocks_) {
+        delete[] block;
+    }
+}
+
+FileReader* FileReader::Instance() {
+    static FileReader reader;
+    return &reader;
+}
+
+void FileReader::Init(int threadNum, size_t blockSize, size_t maxBlocks) {
+    assert(threadNum > 0 && blockSize > 0);
+    assert(!pool_);
+    blockSize_ = blockSize;
+    maxBlocks_ = maxBlocks;
+    pool_.reset(new ThreadPool(threadNum));
+}
+
+shared_ptr<FileRead> FileReader::Open(int fd, off_t offset, size_t len) {
+    if(!pool_ || len == 0) { return nullptr; }
+    char* block = Alloc_();
+    if(!block) {
+        LOG_DEBUG("FileReader: no free block, fall back to mmap");
+        return nullptr;
+    }
+    shared_ptr<FileRead> read(new FileRead(this, fd, offset, len, block));
+    read->self_ = read;
+    read->Next();
+    return read;
+}
+
+size_t FileReader::BlocksInUse() {
+    lock_guard<mutex> locker(mtx_);
+    return blockCount_ - freeBlocks_.size();
+}
+
+char* FileReader::Alloc_() {
+    lock_guard<mutex> locker(mtx_);
+    if(!freeBlocks_.empty()) {
+        char* block = freeBlocks_.back();
+        freeBlocks_.pop_back();
+        return block;
+    }
+    if(blockCount_ >= maxBlocks_) {
+        return nullptr;
+    }
+    blockCount_++;
+    return new char[blockSize_];
+}
+
+void FileReader::Free_(char* block) {
+    lock_guard<mutex> locker(mtx_);
+    freeBlocks_.push_back(block);
+}
+
+void FileReader::Submit_(const shared_ptr<FileRead>& read) {
+    /* 任务持有 read, 连接关闭后读完才释放文件和缓冲块 */
+    size_t blockSize = blockSize_;
+    pool_->AddTask([read, blockSize] {
+        size_t want = min(read->left_, blockSize);
+        ssize_t len;
+        do {
+            len = pread(read->fd_, read->block_, want, read->offset_);
+        } while(len < 0 && errno == EINTR);
+        if(len > 0) {
+            read->offset_ += len;
+            read->left_ -= len;
+        }
+        else if(len < 0) {
+            len = -errno;
+        }
+        read->Done_(len);
+    });
+}
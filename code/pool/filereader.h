@@ -0,0 +1,90 @@
+#ifndef FILEREADER_H
+#define FILEREADER_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include "threadpool.h"
+#include "../log/log.h"
+
+class FileReader;
+
+/*
+    一个冷文件的后台读取状态, 由连接和正在执行的读任务共同持有
+    文件描述符和缓冲块跟随最后一个持有者释放, 连接提前关闭时读任务不会写到已回收的内存
+*/
+class FileRead {
+public:
+    ~FileRead();
+
+    /* 工作线程: 取已读好的一块, 返回读到的字节数; 还在读时登记等待并返回 0, 读完后调用 ready */
+    ssize_t Take(const std::function<void()>& ready);
+    /* 上一块发送完后开始读下一块, 已读完时返回false */
+    bool Next();
+    /* 连接关闭: 之后完成的读取不再通知 */
+    void Cancel();
+
+    const char* Block() const { return block_; }
+    size_t Left() const { return left_; }
+
+private:
+    friend class FileReader;
+    enum State { IDLE, READING, READY };
+
+    FileRead(FileReader* reader, int fd, off_t offset, size_t len, char* block);
+    void Done_(ssize_t len);
+
+    FileReader* reader_;
+    int fd_;
+    off_t offset_;          // 下一次读取的文件偏移
+    size_t left_;           // 还没有读取的字节数
+    char* block_;
+    ssize_t len_;           // 块中读到的字节数, 出错时为 -errno
+
+    std::mutex mtx_;
+    State state_;
+    bool cancelled_;
+    std::function<void()> ready_;   // 工作线程在等待这一块
+    std::weak_ptr<FileRead> self_;
+};
+
+/*
+    冷文件的读取线程池: 在独立的线程里 pread 到池化的缓冲块中
+    工作线程不会因为 mmap 缺页阻塞在磁盘上, 缓冲块总数有上限, 用完时调用方退回 mmap
+*/
+class FileReader {
+public:
+    static FileReader* Instance();
+
+    void Init(int threadNum, size_t blockSize, size_t maxBlocks);
+    bool IsOpen() const { return static_cast<bool>(pool_); }
+    size_t BlockSize() const { return blockSize_; }
+    /* 正在被读取使用的缓冲块数 */
+    size_t BlocksInUse();
+
+    /* 接管 fd, 读取 [offset, offset + len), 并立即开始读第一块; 缓冲块用完时返回 nullptr, fd 仍归调用方 */
+    std::shared_ptr<FileRead> Open(int fd, off_t offset, size_t len);
+
+private:
+    friend class FileRead;
+    FileReader();
+    ~FileReader();
+
+    char* Alloc_();
+    void Free_(char* block);
+    void Submit_(const std::shared_ptr<FileRead>& read);
+
+    size_t blockSize_;
+    size_t maxBlocks_;
+    size_t blockCount_;
+    std::vector<char*> freeBlocks_;
+    std::mutex mtx_;
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif // FILEREADER_H
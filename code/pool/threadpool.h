@@ -8,13 +8,14 @@
 #include <assert.h>
 #include <thread>
 #include <functional>
+#include <vector>
 
 class ThreadPool{
 public:
     explicit ThreadPool(size_t threadCount = 8) : pool_(std::make_shared<Pool>()){
         assert(threadCount > 0);
         for(size_t i = 0;i < threadCount;i++){
-            std::thread([pool = pool_]{
+            threads_.emplace_back([pool = pool_]{
                 std::unique_lock<std::mutex> locker(pool->mtx);
                 while(true){
                     if(!pool->tasks.empty()){
@@ -27,7 +28,7 @@ public:
                     else if(pool->isClosed)break;
                     else pool->cond.wait(locker);
                 }
-            }).detach();
+            });
         }
     }
 
@@ -42,6 +43,10 @@ public:
             }
             pool_->cond.notify_all();
         }
+        /* 线程执行完队列中剩余的任务后退出, 析构返回时不再有任务在运行 */
+        for(auto& thread: threads_) {
+            if(thread.joinable()) { thread.join(); }
+        }
     }
 
     template<typename F>
@@ -62,6 +67,7 @@ private:
         std::queue<std::function<void()>> tasks;
     };
     std::shared_ptr<Pool> pool_;
+    std::vector<std::thread> threads_;
 
 };
 
@@ -0,0 +1,34 @@
+#include "epollbackend.h"
+#include <assert.h>
+
+EpollBackend::EpollBackend(): epollFd_(epoll_create1(EPOLL_CLOEXEC)) {
+    assert(epollFd_ >= 0);
+}
+
+EpollBackend::~EpollBackend() {
+    close(epollFd_);
+}
+
+bool EpollBackend::Add(int fd, uint32_t events, uint64_t data) {
+    return Ctl_(EPOLL_CTL_ADD, fd, events, data);
+}
+
+bool EpollBackend::Mod(int fd, uint32_t events, uint64_t data) {
+    return Ctl_(EPOLL_CTL_MOD, fd, events, data);
+}
+
+bool EpollBackend::Del(int fd) {
+    return Ctl_(EPOLL_CTL_DEL, fd, 0, 0);
+}
+
+bool EpollBackend::Ctl_(int op, int fd, uint32_t events, uint64_t data) {
+    if(fd < 0) return false;
+    epoll_event ev = {0};
+    ev.data.u64 = data;
+    ev.events = events;
+    return 0 == epoll_ctl(epollFd_, op, fd, &ev);
+}
+
+int EpollBackend::Wait(epoll_event* events, int maxEvents, int timeoutMs) {
+    return epoll_wait(epollFd_, events, maxEvents, timeoutMs);
+}
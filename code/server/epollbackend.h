@@ -0,0 +1,25 @@
+#ifndef EPOLL_BACKEND_H
+#define EPOLL_BACKEND_H
+
+#include <unistd.h>
+#include "eventbackend.h"
+
+class EpollBackend : public EventBackend {
+public:
+    EpollBackend();
+    ~EpollBackend();
+
+    bool Add(int fd, uint32_t events, uint64_t data) override;
+    bool Mod(int fd, uint32_t events, uint64_t data) override;
+    bool Del(int fd) override;
+    int Wait(epoll_event* events, int maxEvents, int timeoutMs) override;
+
+    const char* Name() const override { return "epoll"; }
+
+private:
+    bool Ctl_(int op, int fd, uint32_t events, uint64_t data);
+
+    int epollFd_;
+};
+
+#endif // EPOLL_BACKEND_H
@@ -1,45 +1,80 @@
 #include "epoller.h"
+#include "epollbackend.h"
+#include "uringbackend.h"
 
-Epoller::Epoller(int maxEvent):epollFd_(epoll_create(512)), events_(maxEvent){
-    assert(epollFd_ >= 0 && events_.size() > 0);
+Epoller::Epoller(int maxEvent, bool useUring):events_(maxEvent), spinUs_(0){
+    assert(events_.size() > 0);
+    if(useUring) {
+        std::unique_ptr<UringBackend> uring(new UringBackend());
+        if(uring->IsOpen()) {
+            backend_ = std::move(uring);
+        }
+    }
+    if(!backend_) {
+        backend_.reset(new EpollBackend());
+    }
 }
 
-Epoller::~Epoller() {
-    close(epollFd_);
-}
+Epoller::~Epoller() = default;
 
 bool Epoller::AddFd(int fd, uint32_t events) {
-    if(fd < 0) return false;
-    epoll_event ev = {0};
-    ev.data.fd = fd;
-    ev.events = events;
-    return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    return AddFd(fd, events, MakeTag(fd, 0));
 }
 
 bool Epoller::ModFd(int fd, uint32_t events) {
-    if(fd < 0) return false;
-    epoll_event ev = {0};
-    ev.data.fd = fd;
-    ev.events = events;
-    return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+    return ModFd(fd, events, MakeTag(fd, 0));
+}
+
+bool Epoller::AddFd(int fd, uint32_t events, uint64_t data) {
+    return backend_->Add(fd, events, data);
+}
+
+bool Epoller::ModFd(int fd, uint32_t events, uint64_t data) {
+    return backend_->Mod(fd, events, data);
 }
 
 bool Epoller::DelFd(int fd) {
-    if(fd < 0) return false;
-    epoll_event ev = {0};
-    return 0 == epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &ev);
+    return backend_->Del(fd);
 }
 
 int Epoller::Wait(int timeoutMs) {
-    return epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
+    int maxEvent = static_cast<int>(events_.size());
+    if(spinUs_ <= 0 || timeoutMs == 0) {
+        return backend_->Wait(&events_[0], maxEvent, timeoutMs);
+    }
+    /* 以 CPU 换延迟: 事件到达时不需要经过睡眠和唤醒; 自旋不超过定时器给出的超时 */
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    auto spin = microseconds(spinUs_);
+    if(timeoutMs > 0 && milliseconds(timeoutMs) < spin) {
+        spin = milliseconds(timeoutMs);
+    }
+    auto deadline = start + spin;
+    do {
+        int n = backend_->Wait(&events_[0], maxEvent, 0);
+        if(n != 0) { return n; }
+    } while(steady_clock::now() < deadline);
+    if(timeoutMs > 0) {
+        auto used = duration_cast<milliseconds>(steady_clock::now() - start).count();
+        timeoutMs = used >= timeoutMs ? 0 : timeoutMs - static_cast<int>(used);
+    }
+    return backend_->Wait(&events_[0], maxEvent, timeoutMs);
 }
 
 int Epoller::GetEventFd(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return TagSlot(events_[i].data.u64);
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {
     assert(i < events_.size() && i >= 0);
     return events_[i].events;
-}
\ No newline at end of file
+}
+uint64_t Epoller::GetEventData(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].data.u64;
+}
+
+const char* Epoller::Backend() const {
+    return backend_->Name();
+}
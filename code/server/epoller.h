@@ -8,10 +8,15 @@
 #include <assert.h>
 #include <vector>
 #include <errno.h>
+#include <stdint.h>
+#include <memory>
+#include <chrono>
+#include "eventbackend.h"
 
 class Epoller {
 public:
-    explicit Epoller(int maxEvent = 1024);
+    /* useUring 为true时优先使用 io_uring 后端, 内核不支持时退回 epoll */
+    explicit Epoller(int maxEvent = 1024, bool useUring = false);
 
     ~Epoller();
 
@@ -19,17 +24,43 @@ public:
 
     bool ModFd(int fd,uint32_t events);
 
+    /* data 原样保存在 epoll_data 中, 事件返回时由 GetEventData 取回 */
+    bool AddFd(int fd, uint32_t events, uint64_t data);
+
+    bool ModFd(int fd, uint32_t events, uint64_t data);
+
     bool DelFd(int fd);
 
+    /* 设置了忙轮询时, 先以 0 超时反复查询 spinUs 微秒, 没有事件再阻塞等待 */
     int Wait(int timeoutMs = -1);
 
+    void SetBusyPoll(int spinUs) { spinUs_ = spinUs; }
+
     int GetEventFd(size_t i) const;
 
     uint32_t GetEvents(size_t i) const;
 
+    uint64_t GetEventData(size_t i) const;
+
+    const char* Backend() const;
+
+    /* 低32位为连接槽位, 高32位为代数 */
+    static uint64_t MakeTag(int slot, uint32_t gen) {
+        return static_cast<uint64_t>(gen) << 32 | static_cast<uint32_t>(slot);
+    }
+
+    static int TagSlot(uint64_t tag) {
+        return static_cast<int>(tag & 0xffffffff);
+    }
+
+    static uint32_t TagGen(uint64_t tag) {
+        return static_cast<uint32_t>(tag >> 32);
+    }
+
 private:
-    int epollFd_;
+    std::unique_ptr<EventBackend> backend_;
     std::vector<struct epoll_event> events_;
+    int spinUs_;
 };
 
 #endif // !EPOLLER_H
@@ -0,0 +1,26 @@
+#ifndef EVENT_BACKEND_H
+#define EVENT_BACKEND_H
+
+#include <sys/epoll.h>
+#include <stdint.h>
+
+/*
+    Epoller 背后的事件后端
+    事件格式沿用 epoll_event: events 为 EPOLLIN/EPOLLOUT 等掩码, data.u64 为注册时的数据
+    Add/Mod/Del 可能在工作线程中调用, 实现需要线程安全; Wait 只在主线程调用
+*/
+class EventBackend {
+public:
+    virtual ~EventBackend() = default;
+
+    virtual bool Add(int fd, uint32_t events, uint64_t data) = 0;
+    virtual bool Mod(int fd, uint32_t events, uint64_t data) = 0;
+    virtual bool Del(int fd) = 0;
+
+    /* 返回就绪事件数, 超时返回0, 出错返回-1 */
+    virtual int Wait(epoll_event* events, int maxEvents, int timeoutMs) = 0;
+
+    virtual const char* Name() const = 0;
+};
+
+#endif // EVENT_BACKEND_H
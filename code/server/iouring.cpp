@@ -0,0 +1,128 @@
+#include "iouring.h"
+
+IoUring::IoUring(): ringFd_(-1), sqRing_(MAP_FAILED), sqRingSize_(0), cqRing_(MAP_FAILED),
+    cqRingSize_(0), sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize_(0),
+    sqTail_(0), submitted_(0) {}
+
+IoUring::~IoUring() {
+    Close();
+}
+
+bool IoUring::Init(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 4;
+    ringFd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd_ < 0) {
+        ringFd_ = -1;
+        return false;
+    }
+    /* 需要单次 mmap 映射 SQ/CQ, 以及 io_uring_enter 带超时参数 */
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        Close();
+        return false;
+    }
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if(cqRingSize_ > sqRingSize_) { sqRingSize_ = cqRingSize_; }
+    cqRingSize_ = sqRingSize_;
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    cqRing_ = sqRing_;
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if(sqes_ == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTailShared_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqTail_ = submitted_ = *sqTailShared_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void IoUring::Close() {
+    if(sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqesSize_);
+        sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    }
+    if(sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = cqRing_ = MAP_FAILED;
+    }
+    if(ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if(sqTail_ - head >= sqEntries_) {
+        return nullptr;
+    }
+    unsigned idx = sqTail_ & sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    sqTail_++;
+    return sqe;
+}
+
+unsigned IoUring::Publish() {
+    unsigned count = sqTail_ - submitted_;
+    /* SQE 内容写完后再发布尾指针 */
+    __atomic_store_n(sqTailShared_, sqTail_, __ATOMIC_RELEASE);
+    submitted_ = sqTail_;
+    return count;
+}
+
+int IoUring::Enter(unsigned toSubmit, unsigned minComplete, int timeoutMs) {
+    if(toSubmit == 0 && minComplete == 0) {
+        return 0;
+    }
+    unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    void* arg = nullptr;
+    size_t argSize = 0;
+    struct __kernel_timespec ts;
+    io_uring_getevents_arg getArg;
+    if(minComplete > 0 && timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+        memset(&getArg, 0, sizeof(getArg));
+        getArg.ts = reinterpret_cast<__u64>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        arg = &getArg;
+        argSize = sizeof(getArg);
+    }
+    int ret = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSize);
+    return ret < 0 ? -errno : ret;
+}
+
+io_uring_cqe* IoUring::PeekCqe() {
+    unsigned head = *cqHead_;
+    if(head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &cqes_[head & cqMask_];
+}
+
+void IoUring::SeenCqe() {
+    __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE);
+}
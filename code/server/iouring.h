@@ -0,0 +1,67 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+    io_uring 的最小封装, 直接使用系统调用, 不依赖 liburing
+    只负责环的建立和 SQE/CQE 的存取, 不加锁, 多线程使用时由调用方加锁
+*/
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+
+    /* 内核不支持或参数不满足时返回false */
+    bool Init(unsigned entries);
+    void Close();
+    bool IsOpen() const { return ringFd_ >= 0; }
+
+    /* SQ 已满时返回nullptr, 调用方先 Submit 再取 */
+    io_uring_sqe* GetSqe();
+
+    /* 把已放入的 SQE 发布给内核, 返回本次发布的数量 */
+    unsigned Publish();
+    /* 提交 toSubmit 个已发布的 SQE; minComplete > 0 时等待完成, timeoutMs < 0 表示不限时
+       可以和其他线程的 Enter 并发(例如一个线程阻塞等待时另一个线程提交), 返回 -errno 表示失败 */
+    int Enter(unsigned toSubmit, unsigned minComplete = 0, int timeoutMs = -1);
+    /* Publish + Enter */
+    int Submit(unsigned minComplete = 0, int timeoutMs = -1) {
+        return Enter(Publish(), minComplete, timeoutMs);
+    }
+
+    /* 没有完成事件时返回nullptr; 用完后调用 SeenCqe */
+    io_uring_cqe* PeekCqe();
+    void SeenCqe();
+
+private:
+    int ringFd_;
+
+    void* sqRing_;
+    size_t sqRingSize_;
+    void* cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTailShared_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned* sqArray_;
+    unsigned sqTail_;       // 本地尾指针, Publish 时写给内核
+    unsigned submitted_;    // 已发布的尾指针
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+};
+
+#endif // IO_URING_H
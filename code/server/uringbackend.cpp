@@ -0,0 +1,155 @@
+#include "uringbackend.h"
+#include <assert.h>
+#include <endian.h>
+
+UringBackend::UringBackend(unsigned entries): unsubmitted_(0), waiting_(false) {
+    ring_.Init(entries);
+}
+
+bool UringBackend::Add(int fd, uint32_t events, uint64_t data) {
+    return Register_(fd, events, data);
+}
+
+bool UringBackend::Mod(int fd, uint32_t events, uint64_t data) {
+    return Register_(fd, events, data);
+}
+
+bool UringBackend::Register_(int fd, uint32_t events, uint64_t data) {
+    if(fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Reg& reg = Reg_(fd);
+    if(reg.armed) {
+        Cancel_(fd);
+    }
+    reg.data = data;
+    reg.events = events;
+    reg.persistent = !(events & EPOLLONESHOT);
+    Arm_(fd);
+    if(waiting_) {
+        Flush_();
+    }
+    return true;
+}
+
+bool UringBackend::Del(int fd) {
+    if(fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    Reg& reg = Reg_(fd);
+    reg.persistent = false;
+    if(reg.armed) {
+        /* 挂着的 poll 持有文件引用, 必须在 close 之前撤销, 否则连接不会真正关闭 */
+        Cancel_(fd);
+        Flush_();
+    }
+    return true;
+}
+
+UringBackend::Reg& UringBackend::Reg_(int fd) {
+    if(static_cast<size_t>(fd) >= regs_.size()) {
+        regs_.resize(fd + 1);
+    }
+    return regs_[fd];
+}
+
+void UringBackend::Arm_(int fd) {
+    Reg& reg = regs_[fd];
+    reg.seq++;
+    uint32_t mask = reg.events & ~(EPOLLET | EPOLLONESHOT);
+#if __BYTE_ORDER == __BIG_ENDIAN
+    mask = mask << 16 | mask >> 16;
+#endif
+    io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->user_data = UserData_(fd, reg.seq);
+    reg.armed = true;
+}
+
+void UringBackend::Cancel_(int fd) {
+    Reg& reg = regs_[fd];
+    io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = UserData_(fd, reg.seq);
+    sqe->user_data = CANCEL_TAG;
+    reg.seq++;
+    reg.armed = false;
+}
+
+io_uring_sqe* UringBackend::GetSqe_() {
+    io_uring_sqe* sqe = ring_.GetSqe();
+    while(!sqe) {
+        /* SQ 满了, 先交给内核腾出位置 */
+        Flush_();
+        sqe = ring_.GetSqe();
+    }
+    return sqe;
+}
+
+void UringBackend::Flush_() {
+    unsigned toSubmit = unsubmitted_ + ring_.Publish();
+    unsubmitted_ = 0;
+    Settle_(toSubmit, ring_.Enter(toSubmit));
+}
+
+void UringBackend::Settle_(unsigned toSubmit, int ret) {
+    /* 没有提交成功的部分留到下一次 */
+    if(ret < 0) {
+        unsubmitted_ += toSubmit;
+    } else if(static_cast<unsigned>(ret) < toSubmit) {
+        unsubmitted_ += toSubmit - ret;
+    }
+}
+
+int UringBackend::Wait(epoll_event* events, int maxEvents, int timeoutMs) {
+    std::unique_lock<std::mutex> locker(mtx_);
+    int n = Reap_(events, maxEvents);
+    if(n > 0 || timeoutMs == 0) {
+        Flush_();
+        return n;
+    }
+    /* 提交积攒的重新注册和等待合并为一次系统调用, 等待期间不持锁, 工作线程可以继续注册 */
+    unsigned toSubmit = unsubmitted_ + ring_.Publish();
+    unsubmitted_ = 0;
+    waiting_ = true;
+    locker.unlock();
+    int ret = ring_.Enter(toSubmit, 1, timeoutMs);
+    locker.lock();
+    waiting_ = false;
+    if(ret < 0 && ret != -ETIME && ret != -EINTR) {
+        Settle_(toSubmit, ret);
+        errno = -ret;
+        return -1;
+    }
+    Settle_(toSubmit, ret < 0 ? static_cast<int>(toSubmit) : ret);
+    return Reap_(events, maxEvents);
+}
+
+int UringBackend::Reap_(epoll_event* events, int maxEvents) {
+    int n = 0;
+    io_uring_cqe* cqe;
+    while(n < maxEvents && (cqe = ring_.PeekCqe())) {
+        uint64_t userData = cqe->user_data;
+        int res = cqe->res;
+        ring_.SeenCqe();
+        if(userData == CANCEL_TAG) {
+            continue;
+        }
+        size_t fd = userData & 0xffffffff;
+        uint32_t seq = userData >> 32;
+        if(fd >= regs_.size() || !regs_[fd].armed || regs_[fd].seq != seq) {
+            /* 已撤销或已重新注册 */
+            continue;
+        }
+        Reg& reg = regs_[fd];
+        reg.armed = false;
+        events[n].events = res < 0 ? EPOLLERR : static_cast<uint32_t>(res);
+        events[n].data.u64 = reg.data;
+        n++;
+        if(reg.persistent) {
+            Arm_(fd);
+        }
+    }
+    return n;
+}
@@ -0,0 +1,62 @@
+#ifndef URING_BACKEND_H
+#define URING_BACKEND_H
+
+#include <vector>
+#include <mutex>
+#include "eventbackend.h"
+#include "iouring.h"
+
+/*
+    基于 io_uring 的事件后端
+    每次注册/重新注册是一个 IORING_OP_POLL_ADD(本身就是一次性的, 对应 EPOLLONESHOT)
+    工作线程重新注册时只把 SQE 放进队列, 由主线程在下一次 Wait 时和等待合并成一次 io_uring_enter
+    主线程正阻塞等待时才由工作线程自己提交, 避免注册被延迟到超时
+    未设置 EPOLLONESHOT 的 fd(监听 fd)在事件返回后自动重新注册
+*/
+class UringBackend : public EventBackend {
+public:
+    explicit UringBackend(unsigned entries = 4096);
+    ~UringBackend() = default;
+
+    /* 内核不支持 io_uring 时为false, 调用方应退回 epoll */
+    bool IsOpen() const { return ring_.IsOpen(); }
+
+    bool Add(int fd, uint32_t events, uint64_t data) override;
+    bool Mod(int fd, uint32_t events, uint64_t data) override;
+    bool Del(int fd) override;
+    int Wait(epoll_event* events, int maxEvents, int timeoutMs) override;
+
+    const char* Name() const override { return "io_uring"; }
+
+private:
+    struct Reg {
+        uint64_t data = 0;
+        uint32_t events = 0;
+        uint32_t seq = 0;           // 每次挂上/撤销加一, 旧的完成事件据此丢弃
+        bool armed = false;
+        bool persistent = false;
+    };
+
+    bool Register_(int fd, uint32_t events, uint64_t data);
+    Reg& Reg_(int fd);
+    void Arm_(int fd);
+    void Cancel_(int fd);
+    io_uring_sqe* GetSqe_();
+    void Flush_();
+    void Settle_(unsigned toSubmit, int ret);
+    int Reap_(epoll_event* events, int maxEvents);
+
+    static uint64_t UserData_(int fd, uint32_t seq) {
+        return static_cast<uint64_t>(seq) << 32 | static_cast<uint32_t>(fd);
+    }
+
+    static const uint64_t CANCEL_TAG = ~0ULL;
+
+    IoUring ring_;
+    std::mutex mtx_;
+    std::vector<Reg> regs_;
+    unsigned unsubmitted_;  // 已发布但还没有被内核取走的 SQE
+    bool waiting_;          // 主线程正阻塞在 io_uring_enter 中
+};
+
+#endif // URING_BACKEND_H
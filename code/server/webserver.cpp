@@ -2,13 +2,32 @@
 
 using namespace std;
 
+extern char** environ;
+
+int WebServer::listenBacklog = SOMAXCONN;
+int WebServer::acceptBatch = 64;
+bool WebServer::useUring = false;
+int WebServer::fileReadThreads = 4;
+size_t WebServer::fileReadBlocks = 256;
+int WebServer::eventBatch = 1024;
+int WebServer::busyPollUS = 0;
+int WebServer::sockBusyPollUS = 0;
+int WebServer::drainTimeoutMS = 30000;
+string WebServer::metricsPath = "";
+string WebServer::traceFile = "./log/trace.json";
+int WebServer::signalPipe_[2] = { -1, -1 };
+const char WebServer::LISTEN_FD_ENV[] = "WEBSERVER_LISTEN_FD";
+const char WebServer::READY_FD_ENV[] = "WEBSERVER_READY_FD";
+
 WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
+            bool openLog, int logLevel, int logQueSize,
+            const char* bundlePath):
             port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            inherited_(false), readyFd_(-1), upgradeFd_(-1), upgradePid_(-1), draining_(false),
+            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller(eventBatch, useUring))
     {
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
@@ -16,9 +35,21 @@ WebServer::WebServer(
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
     SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    if(fileReadThreads > 0) {
+        FileReader::Instance()->Init(fileReadThreads, FILE_BLOCK_SIZE, fileReadBlocks);
+    }
 
     InitEventMode_(trigMode);
-    if(!InitSocket_()) { isClose_ = true;}
+    InitConnTable_();
+    InitMetrics_();
+    epoller_->SetBusyPoll(busyPollUS);
+    /* 由旧进程启动时, 开始服务后通过这个管道通知旧进程 */
+    if(const char* ready = getenv(READY_FD_ENV)) {
+        readyFd_ = atoi(ready);
+        unsetenv(READY_FD_ENV);
+        fcntl(readyFd_, F_SETFD, FD_CLOEXEC);
+    }
+    if(!InitSocket_() || !InitSignal_()) { isClose_ = true;}
 
     if(openLog) {
         Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
@@ -31,16 +62,32 @@ WebServer::WebServer(
                             (connEvent_ & EPOLLET ? "ET": "LT"));
             LOG_INFO("LogSys level: %d", logLevel);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Request scan: %s, Event backend: %s", ScanImpl(), epoller_->Backend());
+            LOG_INFO("Event batch: %d, Busy poll: %dus, Socket busy poll: %dus",
+                            eventBatch, busyPollUS, sockBusyPollUS);
+            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d, FileReader num: %d",
+                            connPoolNum, threadNum, fileReadThreads);
+            LOG_INFO("Conn table size: %d", (int)users_.size());
+            if(inherited_) { LOG_INFO("Listen socket inherited from the previous process"); }
         }
     }
+    /* 有资源包时优先从资源包返回, 包中没有的文件仍从 srcDir 读取 */
+    if(bundlePath && !Bundle::Instance()->Open(bundlePath)) {
+        LOG_WARN("Bundle %s not loaded, serving from %s", bundlePath, HttpConn::srcDir);
+    }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);
+    if(listenFd_ >= 0) { close(listenFd_); }
     isClose_ = true;
-    free(srcDir_);
+    /* 等工作线程执行完已提交的任务, 之后连接和数据库连接池才能释放 */
+    threadpool_.reset();
     SqlConnPool::Instance()->ClosePool();
+    /* 开启追踪时, 退出前留下最后一段记录 */
+    if(Tracer::sampleEvery > 0) { DumpTrace_(); }
+    free(srcDir_);
+    LOG_INFO("========== Server stop ==========");
+    Log::Instance()->StopAsync();
 }
 
 void WebServer::InitEventMode_(int trigMode) {
@@ -66,38 +113,58 @@ void WebServer::InitEventMode_(int trigMode) {
         break;
     }
     HttpConn::isET = (connEvent_ & EPOLLET);
+    HttpConn::onFileReady = [this](HttpConn* client) {
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, ConnTag_(client));
+    };
 }
 
 void WebServer::Start() {
     int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
-    if(!isClose_) { LOG_INFO("========== Server start =========="); }
+    if(!isClose_) {
+        LOG_INFO("========== Server start ==========");
+        NotifyReady_();
+    }
     while(!isClose_) {
-        if(timeoutMS_ > 0) {
+        if(UseTimer_()) {
             timeMS = timer_->GetNextTick();
         }
+        if(draining_ && (timeMS < 0 || timeMS > DRAIN_TICK_MS)) {
+            /* 排空期间定期检查空闲连接和期限 */
+            timeMS = DRAIN_TICK_MS;
+        }
         int eventCnt = epoller_->Wait(timeMS);
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
-            int fd = epoller_->GetEventFd(i);
+            /* epoll_data 中是槽位和代数, 直接定位连接, 代数不符说明是 fd 复用前的过期事件 */
+            uint64_t tag = epoller_->GetEventData(i);
+            int fd = Epoller::TagSlot(tag);
             uint32_t events = epoller_->GetEvents(i);
+            HttpConn* client = nullptr;
             if(fd == listenFd_) {
                 DealListen_();
             }
+            else if(fd == signalPipe_[0]) {
+                DealSignal_();
+            }
+            else if(fd == upgradeFd_) {
+                DealUpgrade_();
+            }
+            else if(!(client = Conn_(fd)) || client->GetGen() != Epoller::TagGen(tag) || client->IsClosed()) {
+                LOG_WARN("Stale event on fd[%d]", fd);
+            }
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+                CloseConn_(client);
             }
             else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                DealRead_(client);
             }
             else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(client);
             } else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        if(draining_) { Drain_(); }
     }
 }
 
@@ -117,47 +184,170 @@ void WebServer::CloseConn_(HttpConn* client) {
     client->Close();
 }
 
+void WebServer::CloseNow_(HttpConn* client) {
+    /* 服务端主动关闭: 连同定时器结点一起删除 */
+    timer_->remove(client->GetFd());
+    CloseConn_(client);
+}
+
 void WebServer::AddClient_(int fd, sockaddr_in addr) {
-    assert(fd > 0);
-    users_[fd].init(fd, addr);
-    if(timeoutMS_ > 0) {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+    assert(fd > 0 && fd < static_cast<int>(users_.size()));
+    if(!users_[fd]) {
+        users_[fd].reset(new HttpConn());
     }
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    HttpConn* client = users_[fd].get();
+    if(sockBusyPollUS > 0
+        && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &sockBusyPollUS, sizeof(sockBusyPollUS)) < 0) {
+        /* 超过 net.core.busy_read 需要 CAP_NET_ADMIN, 失败时连接照常使用 */
+        LOG_DEBUG("SO_BUSY_POLL on client[%d] error: %d", fd, errno);
+    }
+    /* fd 由 accept4 设为非阻塞, 连接对象和定时器都就绪后才加入 epoll */
+    client->init(fd, addr);
+    if(UseTimer_()) { ArmTimer_(client); }
+    if(!epoller_->AddFd(fd, EPOLLIN | connEvent_, ConnTag_(client))) {
+        LOG_ERROR("Add client[%d] error!", fd);
+        timer_->remove(fd);
+        client->Close();
+        return;
+    }
+    Metrics::Add(Metrics::ACCEPTS);
+    LOG_INFO("Client[%d] in!", fd);
+}
+
+void WebServer::InitConnTable_() {
+    /* 槽位数取 MAX_FD 与进程 fd 上限中较小的一个, fd 超出范围的连接直接拒绝 */
+    size_t size = MAX_FD;
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+        && limit.rlim_cur < size) {
+        size = limit.rlim_cur;
+    }
+    users_.resize(size);
+}
+
+void WebServer::InitMetrics_() {
+    if(metricsPath.empty()) {
+        return;
+    }
+    Metrics::Instance()->AddGauge("connections", "Open client connections.", [] {
+        return static_cast<double>(HttpConn::userCount);
+    });
+    Metrics::Instance()->AddGauge("file_read_blocks", "Buffer blocks held by cold file reads.", [] {
+        return static_cast<double>(FileReader::Instance()->BlocksInUse());
+    });
+    /* 抓取时才汇总各线程的分片, 整段文本作为一个 chunk 发出 */
+    Router::Instance()->Add("GET", metricsPath, [](const HttpRequest&, HttpResponse& resp) {
+        resp.SetGenerator([](Buffer& out) {
+            string text;
+            Metrics::Instance()->Export(text);
+            out.Append(text);
+            return false;
+        }, "text/plain; version=0.0.4");
+    });
+}
+
+uint64_t WebServer::ConnTag_(const HttpConn* client) {
+    return Epoller::MakeTag(client->GetFd(), client->GetGen());
+}
+
+HttpConn* WebServer::Conn_(int fd) const {
+    if(fd < 0 || fd >= static_cast<int>(users_.size())) {
+        return nullptr;
+    }
+    return users_[fd].get();
 }
 
 void WebServer::DealListen_() {
     struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-    do {
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
-        if(fd <= 0) { return;}
-        else if(HttpConn::userCount >= MAX_FD) {
+    int i = 0;
+    for(; acceptBatch <= 0 || i < acceptBatch; i++) {
+        socklen_t len = sizeof(addr);
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_WARN("accept error: %d", errno);
+            }
+            return;
+        }
+        else if(fd >= static_cast<int>(users_.size())) {
+            Metrics::Add(Metrics::REJECTS);
             SendError_(fd, "Server busy!");
             LOG_WARN("Clients is full!");
-            return;
+            continue;
         }
         AddClient_(fd, addr);
-    } while(listenEvent_ & EPOLLET);
+    }
+    /* 一批取满, 剩下的连接留到下一轮; ET 模式下重新注册监听 fd, 让 epoll 再通知一次 */
+    if(listenEvent_ & EPOLLET) {
+        epoller_->ModFd(listenFd_, listenEvent_ | EPOLLIN);
+    }
 }
 
 void WebServer::DealRead_(HttpConn* client) {
     assert(client);
+    client->SetBusy();
     ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    client->SampleTrace();
+    uint32_t gen = client->GetGen();
+    uint64_t traceId = client->TraceId();
+    uint64_t queued = traceId ? Metrics::Now() : 0;
+    Metrics::Add(Metrics::TASKS_QUEUED);
+    threadpool_->AddTask([this, client, gen, traceId, queued] {
+        Metrics::Add(Metrics::TASKS_STARTED);
+        /* 排队期间连接被定时器关闭且 fd 已分给新客户端时, 丢弃这个过期任务 */
+        if(client->GetGen() != gen) { return; }
+        Tracer::SetCurrent(traceId);
+        Tracer::Record("queue", queued, Metrics::Now());
+        OnRead_(client);
+        Tracer::SetCurrent(0);
+    });
 }
 
 void WebServer::DealWrite_(HttpConn* client) {
     assert(client);
+    client->SetBusy();
     ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    uint32_t gen = client->GetGen();
+    uint64_t traceId = client->TraceId();
+    uint64_t queued = traceId ? Metrics::Now() : 0;
+    Metrics::Add(Metrics::TASKS_QUEUED);
+    threadpool_->AddTask([this, client, gen, traceId, queued] {
+        Metrics::Add(Metrics::TASKS_STARTED);
+        if(client->GetGen() != gen) { return; }
+        Tracer::SetCurrent(traceId);
+        Tracer::Record("queue", queued, Metrics::Now());
+        OnWrite_(client);
+        Tracer::SetCurrent(0);
+    });
 }
 
 void WebServer::ExtentTime_(HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    client->Touch();
+    if(UseTimer_()) { ArmTimer_(client); }
+}
+
+void WebServer::ArmTimer_(HttpConn* client) {
+    /* 结点已存在时 add 只更新期限 */
+    uint32_t gen = client->GetGen();
+    timer_->add(client->GetFd(), client->TimeoutMS(timeoutMS_), [this, client, gen] {
+        OnTimeout_(client, gen);
+    });
+}
+
+void WebServer::OnTimeout_(HttpConn* client, uint32_t gen) {
+    if(client->GetGen() != gen || client->IsClosed()) { return; }
+    /* 结点按最早的期限触发, 请求头期限和空闲期限都没到时重新计时 */
+    if(client->TimeoutMS(timeoutMS_) > 0) {
+        ArmTimer_(client);
+        return;
+    }
+    CloseConn_(client);
+}
+
+bool WebServer::UseTimer_() const {
+    /* 关闭空闲超时时, 仍然需要定时器限制请求头的读取时间 */
+    return timeoutMS_ > 0 || HttpConn::headerTimeoutMS > 0;
 }
 
 void WebServer::OnRead_(HttpConn* client) {
@@ -173,31 +363,38 @@ void WebServer::OnRead_(HttpConn* client) {
 }
 
 void WebServer::OnProcess(HttpConn* client) {
+    uint32_t seq = client->OwnerSeq();
     if(client->process()) {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, ConnTag_(client));
     } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN, ConnTag_(client));
     }
+    /* 重新注册之后不再访问连接的其他状态, 只交还所有权 */
+    client->HandBack(seq);
 }
 
 void WebServer::OnWrite_(HttpConn* client) {
     assert(client);
     int ret = -1;
     int writeErrno = 0;
+    uint32_t seq = client->OwnerSeq();
     ret = client->write(&writeErrno);
-    if(client->ToWriteBytes() == 0) {
+    if(ret < 0 && writeErrno == EINPROGRESS) {
+        /* 冷文件的下一块还在读, 读完后由读线程注册 EPOLLOUT, 这里不能再访问连接 */
+        return;
+    }
+    if(client->IsWriteDone()) {
         /* 传输完成 */
         if(client->IsKeepAlive()) {
             OnProcess(client);
             return;
         }
     }
-    else if(ret < 0) {
-        if(writeErrno == EAGAIN) {
-            /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
-            return;
-        }
+    else if(ret > 0 || writeErrno == EAGAIN) {
+        /* 继续传输: 等待下一次可写再发送(写满本轮额度或流式响应生成下一块时也走这里) */
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, ConnTag_(client));
+        client->HandBack(seq);
+        return;
     }
     CloseConn_(client);
 }
@@ -220,7 +417,13 @@ bool WebServer::InitSocket_() {
         optLinger.l_linger = 1;
     }
 
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    listenFd_ = InheritListenFd_();
+    if(listenFd_ >= 0) {
+        inherited_ = true;
+        return AddListenFd_();
+    }
+
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if(listenFd_ < 0) {
         LOG_ERROR("Create socket error!", port_);
         return false;
@@ -250,26 +453,300 @@ bool WebServer::InitSocket_() {
         return false;
     }
 
-    ret = listen(listenFd_, 6);
+    ret = listen(listenFd_, listenBacklog);
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
         close(listenFd_);
         return false;
     }
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
+    return AddListenFd_();
+}
+
+bool WebServer::AddListenFd_() {
+    SetFdNonblock(listenFd_);
+    int ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
     if(ret == 0) {
         LOG_ERROR("Add listen error!");
         close(listenFd_);
         return false;
     }
-    SetFdNonblock(listenFd_);
     LOG_INFO("Server port:%d", port_);
     return true;
 }
 
 int WebServer::SetFdNonblock(int fd) {
     assert(fd > 0);
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+void WebServer::CloseFds_(int first, int last) {
+    /* fork 之后调用, 只用系统调用; 内核不支持 close_range 时逐个关闭 */
+    if(first > last) { return; }
+#ifdef SYS_close_range
+    if(syscall(SYS_close_range, first, last, 0) == 0) { return; }
+#endif
+    for(int fd = first; fd <= last; fd++) {
+        close(fd);
+    }
+}
+
+
+
+int WebServer::InheritListenFd_() {
+    /* 平滑升级: 旧进程通过环境变量传下监听套接字, 排队中的连接不会被拒绝 */
+    const char* env = getenv(LISTEN_FD_ENV);
+    if(!env) {
+        return -1;
+    }
+    int fd = atoi(env);
+    unsetenv(LISTEN_FD_ENV);
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int listening = 0;
+    socklen_t optLen = sizeof(listening);
+    if(fd <= 0 || getsockname(fd, (struct sockaddr *)&addr, &len) < 0 || addr.sin_family != AF_INET
+        || getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optLen) < 0 || !listening) {
+        return -1;
+    }
+    if(ntohs(addr.sin_port) != port_) {
+        /* 端口改了, 重新监听, 旧端口随旧进程退出关闭 */
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    listen(fd, listenBacklog);
+    return fd;
+}
+
+bool WebServer::InitSignal_() {
+    /* 信号可能打断任意线程, 处理函数只向管道写入信号值 */
+    if(pipe2(signalPipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+        LOG_ERROR("Create signal pipe error!");
+        return false;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal_;
+    sa.sa_flags = SA_RESTART;
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, nullptr);
+    sigaction(SIGUSR2, &sa, nullptr);
+    sigaction(SIGUSR1, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+    /* 对端关闭后 writev 返回 EPIPE 即可, 不能让进程退出 */
+    signal(SIGPIPE, SIG_IGN);
+    return epoller_->AddFd(signalPipe_[0], EPOLLIN);
+}
+
+void WebServer::OnSignal_(int sig) {
+    int savedErrno = errno;
+    char ch = static_cast<char>(sig);
+    ssize_t ret = write(signalPipe_[1], &ch, 1);
+    (void)ret;
+    errno = savedErrno;
+}
+
+void WebServer::DealSignal_() {
+    char sigs[16];
+    ssize_t len;
+    while((len = read(signalPipe_[0], sigs, sizeof(sigs))) > 0) {
+        for(ssize_t i = 0; i < len; i++) {
+            if(sigs[i] == SIGHUP) { Reload_(); }
+            else if(sigs[i] == SIGUSR2) { Upgrade_(); }
+            else if(sigs[i] == SIGUSR1) { DumpTrace_(); }
+            else if(sigs[i] == SIGTERM || sigs[i] == SIGINT) { Shutdown_(); }
+        }
+    }
+}
+
+void WebServer::Reload_() {
+    if(!reload_) {
+        LOG_WARN("SIGHUP ignored: no reload handler");
+        return;
+    }
+    /* 定时器只在启动时决定是否使用, 运行中不能在开与关之间切换 */
+    bool useTimer = UseTimer_();
+    int timeoutMS = timeoutMS_;
+    int headerTimeoutMS = HttpConn::headerTimeoutMS;
+    if(!reload_(*this)) {
+        LOG_ERROR("Reload failed, keep current settings");
+        return;
+    }
+    if(UseTimer_() != useTimer) {
+        timeoutMS_ = timeoutMS;
+        HttpConn::headerTimeoutMS = headerTimeoutMS;
+        LOG_WARN("Turning timeouts on or off takes effect after upgrade (SIGUSR2)");
+    }
+    epoller_->SetBusyPoll(busyPollUS);
+    LOG_INFO("Configuration reloaded");
+}
+
+void WebServer::DumpTrace_() {
+    int count = Tracer::Instance()->Dump(traceFile.c_str());
+    if(count < 0) {
+        LOG_ERROR("Write trace %s error: %d", traceFile.c_str(), errno);
+    }
+    else {
+        LOG_INFO("Trace: %d spans written to %s", count, traceFile.c_str());
+    }
+}
+
+void WebServer::Upgrade_() {
+    if(upgradePid_ > 0 || draining_) {
+        LOG_WARN("Upgrade already in progress");
+        return;
+    }
+    /* 新进程使用同样的程序和参数; fork 之后只调用 async-signal-safe 的函数, 参数和环境提前准备好 */
+    vector<string> args;
+    FILE* fp = fopen("/proc/self/cmdline", "re");
+    if(fp) {
+        string arg;
+        int ch;
+        while((ch = fgetc(fp)) != EOF) {
+            if(ch == '\0') {
+                args.push_back(arg);
+                arg.clear();
+            }
+            else { arg.push_back(static_cast<char>(ch)); }
+        }
+        fclose(fp);
+    }
+    /* 按路径执行, 替换过的可执行文件才会生效; 原文件被删除或覆盖时 readlink 结果带 " (deleted)" 后缀 */
+    char exe[PATH_MAX];
+    ssize_t exeLen = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    string exePath = exeLen > 0 ? string(exe, exeLen) : "";
+    const string deleted = " (deleted)";
+    if(exePath.size() > deleted.size()
+        && exePath.compare(exePath.size() - deleted.size(), deleted.size(), deleted) == 0) {
+        exePath.resize(exePath.size() - deleted.size());
+    }
+    int ready[2];
+    if(args.empty() || exePath.empty() || pipe2(ready, O_CLOEXEC) < 0) {
+        LOG_ERROR("Upgrade: can't prepare the new process");
+        return;
+    }
+    vector<string> envs;
+    for(char** env = environ; *env; env++) {
+        if(strncmp(*env, LISTEN_FD_ENV, sizeof(LISTEN_FD_ENV) - 1) != 0
+            && strncmp(*env, READY_FD_ENV, sizeof(READY_FD_ENV) - 1) != 0) {
+            envs.push_back(*env);
+        }
+    }
+    envs.push_back(string(LISTEN_FD_ENV) + "=" + to_string(listenFd_));
+    envs.push_back(string(READY_FD_ENV) + "=" + to_string(ready[1]));
+    vector<char*> argv, envp;
+    for(auto& arg: args) { argv.push_back(&arg[0]); }
+    for(auto& env: envs) { envp.push_back(&env[0]); }
+    argv.push_back(nullptr);
+    envp.push_back(nullptr);
+
+    int maxFd = static_cast<int>(sysconf(_SC_OPEN_MAX)) - 1;
+    int keepLow = min(listenFd_, ready[1]), keepHigh = max(listenFd_, ready[1]);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        /* 只有监听套接字和就绪管道留给新进程; 第三方库(如 MySQL 客户端)打开的描述符不一定带 CLOEXEC, 全部关闭 */
+        CloseFds_(3, keepLow - 1);
+        CloseFds_(keepLow + 1, keepHigh - 1);
+        CloseFds_(keepHigh + 1, maxFd);
+        fcntl(listenFd_, F_SETFD, 0);
+        fcntl(ready[1], F_SETFD, 0);
+        execve(exePath.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+    close(ready[1]);
+    if(pid < 0) {
+        close(ready[0]);
+        LOG_ERROR("Upgrade: fork error: %d", errno);
+        return;
+    }
+    /* 新进程就绪之前仍然正常接受连接, 启动失败不影响服务 */
+    upgradePid_ = pid;
+    upgradeFd_ = ready[0];
+    SetFdNonblock(upgradeFd_);
+    epoller_->AddFd(upgradeFd_, EPOLLIN);
+    LOG_INFO("Upgrade: started new process %d", pid);
 }
 
+void WebServer::DealUpgrade_() {
+    char ch;
+    ssize_t len = read(upgradeFd_, &ch, 1);
+    if(len < 0 && errno == EAGAIN) {
+        return;
+    }
+    epoller_->DelFd(upgradeFd_);
+    close(upgradeFd_);
+    upgradeFd_ = -1;
+    /* 新进程以守护进程运行时, 直接子进程会先退出, 这里不阻塞等待 */
+    waitpid(upgradePid_, nullptr, WNOHANG);
+    if(len == 1) {
+        LOG_INFO("Upgrade: new process %d is serving, draining connections", upgradePid_);
+        StartDrain_();
+    }
+    else {
+        LOG_ERROR("Upgrade: new process %d exited before serving, keep running", upgradePid_);
+        upgradePid_ = -1;
+    }
+}
 
+void WebServer::Shutdown_() {
+    /* 排空期间再次收到退出信号时不再等待 */
+    if(draining_) {
+        LOG_WARN("Shutdown: signal received again, closing connections now");
+        drainDeadline_ = chrono::steady_clock::now();
+        return;
+    }
+    LOG_INFO("Shutdown: stop accepting, draining %d connections", (int)HttpConn::userCount);
+    StartDrain_();
+}
+
+void WebServer::NotifyReady_() {
+    if(readyFd_ < 0) {
+        return;
+    }
+    char ch = 1;
+    if(write(readyFd_, &ch, 1) != 1) {
+        LOG_WARN("Notify previous process error: %d", errno);
+    }
+    close(readyFd_);
+    readyFd_ = -1;
+}
+
+void WebServer::StartDrain_() {
+    /* 升级等待期间收到 SIGTERM 等情况会再次调用, 已在排空时不重置期限 */
+    if(draining_) { return; }
+    /* 不再接受新连接; 升级时监听套接字由新进程继续使用 */
+    draining_ = true;
+    HttpConn::draining = true;
+    epoller_->DelFd(listenFd_);
+    close(listenFd_);
+    listenFd_ = -1;
+    drainDeadline_ = chrono::steady_clock::now() + chrono::milliseconds(drainTimeoutMS);
+}
+
+void WebServer::Drain_() {
+    /* 空闲的长连接直接关闭; 正在处理的连接发完响应(Connection: close)后自行关闭 */
+    for(auto& user: users_) {
+        if(user && !user->IsClosed() && user->IsIdle()) {
+            CloseNow_(user.get());
+        }
+    }
+    if(HttpConn::userCount == 0) {
+        LOG_INFO("All connections drained");
+        isClose_ = true;
+    }
+    else if(chrono::steady_clock::now() >= drainDeadline_) {
+        LOG_WARN("Drain timeout, closing %d connections", (int)HttpConn::userCount);
+        for(auto& user: users_) {
+            if(!user || user->IsClosed()) { continue; }
+            /*
+                工作线程还持有的连接不能在这里释放(文件映射, 读取状态都还在使用),
+                只关闭套接字的读写, 工作线程读写失败后自行关闭; 析构时先等工作线程结束
+            */
+            if(user->IsHandedBack()) { CloseNow_(user.get()); }
+            else { shutdown(user->GetFd(), SHUT_RDWR); }
+        }
+        isClose_ = true;
+    }
+}
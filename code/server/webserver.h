@@ -3,6 +3,8 @@
 #define WEBSERVER_H
 
 #include <unordered_map>
+#include <vector>
+#include <memory>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
@@ -10,6 +12,13 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#include <signal.h>
+#include <chrono>
+#include <functional>
 
 #include "epoller.h"
 #include "../log/log.h"
@@ -17,7 +26,15 @@
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAll.h"
+#include "../pool/filereader.h"
 #include "../http/httpconn.h"
+#include "../http/httpscan.h"
+#include "../metrics/metrics.h"
+#include "../metrics/trace.h"
+
+class WebServer;
+/* SIGHUP 时在主线程调用, 重新读取配置并应用可在运行中修改的参数, 返回false时保持原设置 */
+typedef std::function<bool(WebServer&)> ReloadHandler;
 
 class WebServer{
 public:
@@ -25,12 +42,45 @@ public:
         int port, int trigMode, int timeoutMS, bool OptLinger, 
         int sqlPort, const char* sqlUser, const  char* sqlPwd, 
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize,
+        const char* bundlePath = nullptr);
 
     ~WebServer();
     void Start();
+
+    void OnReload(const ReloadHandler& handler) { reload_ = handler; }
+    void SetTimeoutMS(int timeoutMS) { timeoutMS_ = timeoutMS; }
+
+    static int listenBacklog;   // listen 的队列长度, 内核会截断到 net.core.somaxconn
+    static int acceptBatch;     // 每次监听事件最多接受的连接数, <= 0 表示取到 EAGAIN 为止
+    static bool useUring;       // 事件后端使用 io_uring, 需在构造前设置
+    static int fileReadThreads; // 冷文件读线程数, 0 表示总是 mmap 发送
+    static size_t fileReadBlocks;   // 冷文件缓冲块的总数, 用完时退回 mmap
+    static int eventBatch;      // 每次等待最多取回的事件数, 需在构造前设置
+    static int busyPollUS;      // 阻塞等待前忙轮询的微秒数, 0 表示直接阻塞
+    static int sockBusyPollUS;  // 已连接套接字的 SO_BUSY_POLL, 0 表示不设置
+    static int drainTimeoutMS;  // 平滑升级或退出时等待连接结束的期限, 到期强制关闭
+    static std::string metricsPath; // 输出运行指标的路径, 默认为空(不提供), 需在构造前设置
+    static std::string traceFile;   // SIGUSR1 时写出追踪记录的文件
 private:
     bool InitSocket_();
+    int InheritListenFd_();
+    bool AddListenFd_();
+    bool InitSignal_();
+    static void OnSignal_(int sig);
+    void DealSignal_();
+    void Reload_();
+    void Upgrade_();
+    void DealUpgrade_();
+    void Shutdown_();
+    void DumpTrace_();
+    void NotifyReady_();
+    void StartDrain_();
+    void Drain_();
+    void InitConnTable_();
+    void InitMetrics_();
+    HttpConn* Conn_(int fd) const;
+    static uint64_t ConnTag_(const HttpConn* client);
     void InitEventMode_(int trigMode);
     void AddClient_(int fd,sockaddr_in addr);
 
@@ -40,15 +90,24 @@ private:
 
     void SendError_(int fd, const char*info);
     void ExtentTime_(HttpConn* client);
+    void ArmTimer_(HttpConn* client);
+    void OnTimeout_(HttpConn* client, uint32_t gen);
+    bool UseTimer_() const;
     void CloseConn_(HttpConn* client);
+    void CloseNow_(HttpConn* client);
 
     void OnRead_(HttpConn* client);
     void OnWrite_(HttpConn* client);
     void OnProcess(HttpConn* client);
 
     static const int MAX_FD = 65536;
+    static const size_t FILE_BLOCK_SIZE = 256 * 1024;
+    static const int DRAIN_TICK_MS = 100;
+    static const char LISTEN_FD_ENV[];
+    static const char READY_FD_ENV[];
 
     static int SetFdNonblock(int fd);
+    static void CloseFds_(int first, int last);
 
     int port_;
     bool openLinger_;
@@ -56,6 +115,15 @@ private:
     bool isClose_;
     int listenFd_;
     char* srcDir_;
+
+    static int signalPipe_[2];  // 信号处理函数只写管道, 由主线程在事件循环中处理
+    ReloadHandler reload_;
+    bool inherited_;            // 监听套接字来自升级前的旧进程
+    int readyFd_;               // 新进程: 开始服务后写一个字节通知旧进程
+    int upgradeFd_;             // 旧进程: 等待新进程就绪的管道
+    pid_t upgradePid_;
+    bool draining_;
+    std::chrono::steady_clock::time_point drainDeadline_;
     
     uint32_t listenEvent_;
     uint32_t connEvent_;
@@ -63,7 +131,8 @@ private:
     std::unique_ptr<HeapTimer> timer_;
     std::unique_ptr<ThreadPool> threadpool_;
     std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
+    /* 以 fd 为下标的连接表, 启动时按 fd 上限分配槽位, 连接对象第一次用到时创建并一直复用 */
+    std::vector<std::unique_ptr<HttpConn>> users_;
 };
 
 #endif // !WEBSERVER_H
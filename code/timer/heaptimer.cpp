@@ -2,12 +2,12 @@
 
 void HeapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t j = (i - 1) / 2;
-    while(j >= 0) {
+    /* size_t 的 j 永远 >= 0, 以 i 到达堆顶作为结束条件 */
+    while(i > 0) {
+        size_t j = (i - 1) / 2;
         if(heap_[j] < heap_[i]) { break; }
         SwapNode_(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -60,10 +60,19 @@ void HeapTimer::doWork(int id) {
     if(heap_.empty() || ref_.count(id) == 0) {
         return;
     }
+    /* 先删除再回调, 回调里可以为同一个 id 重新添加结点 */
     size_t i = ref_[id];
     TimerNode node = heap_[i];
-    node.cb();
     del_(i);
+    node.cb();
+}
+
+void HeapTimer::remove(int id) {
+    /* 删除指定id结点, 不触发回调 */
+    if(ref_.count(id) == 0) {
+        return;
+    }
+    del_(ref_[id]);
 }
 
 void HeapTimer::del_(size_t index) {
@@ -87,8 +96,12 @@ void HeapTimer::del_(size_t index) {
 void HeapTimer::adjust(int id, int timeout) {
     /* 调整指定id的结点 */
     assert(!heap_.empty() && ref_.count(id) > 0);
-    heap_[ref_[id]].expires = Clock::now() + MS(timeout);;
-    siftdown_(ref_[id], heap_.size());
+    /* 新的超时时间可能比原来早(请求头读取期限), 两个方向都要调整 */
+    size_t i = ref_[id];
+    heap_[i].expires = Clock::now() + MS(timeout);
+    if(!siftdown_(i, heap_.size())) {
+        siftup_(i);
+    }
 }
 
 void HeapTimer::tick() {
@@ -101,8 +114,8 @@ void HeapTimer::tick() {
         if(std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) { 
             break; 
         }
-        node.cb();
         pop();
+        node.cb();
     }
 }
 
@@ -40,6 +40,8 @@ public:
 
     void doWork(int id);
 
+    void remove(int id);
+
     void clear();
 
     void tick();
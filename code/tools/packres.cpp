@@ -0,0 +1,154 @@
+/*
+    构建时打包静态资源: packres <资源目录> <输出文件>
+    预先计算 Content-type / ETag, 文本类文件额外保存 gzip 版本
+*/
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include "../http/bundle.h"
+#include "../http/httpresponse.h"
+#include "../pool/compresscache.h"
+
+using namespace std;
+
+struct PackFile {
+    string path;    // 以 / 开头的请求路径
+    string type;
+    string etag;
+    string data;
+    string gzip;
+    int64_t mtime;
+};
+
+static bool ReadFile(const string& name, string& out) {
+    FILE* fp = fopen(name.c_str(), "rb");
+    if(!fp) { return false; }
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out.append(buf, n);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+static string ContentETag(const string& data) {
+    /* FNV-1a, 内容不变则 ETag 不变, 与构建机器无关 */
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char ch: data) {
+        hash = (hash ^ ch) * 1099511628211ULL;
+    }
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "\"%016llx-%zx\"", (unsigned long long)hash, data.size());
+    return string(buf, n);
+}
+
+static bool Walk(const string& root, const string& rel, vector<PackFile>& files) {
+    DIR* dir = opendir((root + rel).c_str());
+    if(!dir) {
+        fprintf(stderr, "open dir %s%s failed\n", root.c_str(), rel.c_str());
+        return false;
+    }
+    bool ok = true;
+    while(struct dirent* ent = readdir(dir)) {
+        string name = ent->d_name;
+        if(name[0] == '.') { continue; }
+        string path = rel + "/" + name;
+        struct stat st;
+        if(stat((root + path).c_str(), &st) < 0) { continue; }
+        if(S_ISDIR(st.st_mode)) {
+            ok = Walk(root, path, files) && ok;
+            continue;
+        }
+        if(!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)) { continue; }
+        PackFile file;
+        file.path = path;
+        file.type = HttpResponse::MimeType(path);
+        file.mtime = st.st_mtime;
+        if(!ReadFile(root + path, file.data)) {
+            fprintf(stderr, "read %s failed\n", path.c_str());
+            ok = false;
+            continue;
+        }
+        file.etag = ContentETag(file.data);
+        string gz;
+        if(HttpResponse::IsTextType(file.type) && file.data.size() >= 256
+            && CompressCache::Gzip(file.data.data(), file.data.size(), gz, 9)
+            && gz.size() < file.data.size()) {
+            file.gzip = move(gz);
+        }
+        files.push_back(move(file));
+    }
+    closedir(dir);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s <resources dir> <output>\n", argv[0]);
+        return 1;
+    }
+    string root = argv[1];
+    while(root.size() > 1 && root.back() == '/') { root.pop_back(); }
+    vector<PackFile> files;
+    if(!Walk(root, "", files)) {
+        return 1;
+    }
+    sort(files.begin(), files.end(), [](const PackFile& a, const PackFile& b) {
+        return a.path < b.path;
+    });
+
+    /* 先排字符串区, 再排数据区 */
+    BundleHeader header;
+    memcpy(header.magic, Bundle::MAGIC, sizeof(header.magic));
+    header.version = Bundle::VERSION;
+    header.count = files.size();
+    vector<BundleEntry> entries(files.size());
+    string strings, data;
+    uint64_t strBase = sizeof(BundleHeader) + sizeof(BundleEntry) * files.size();
+    for(size_t i = 0; i < files.size(); i++) {
+        BundleEntry& e = entries[i];
+        e.pathOff = strBase + strings.size(); e.pathLen = files[i].path.size();
+        strings += files[i].path;
+        e.typeOff = strBase + strings.size(); e.typeLen = files[i].type.size();
+        strings += files[i].type;
+        e.etagOff = strBase + strings.size(); e.etagLen = files[i].etag.size();
+        strings += files[i].etag;
+        e.mtime = files[i].mtime;
+    }
+    /* 数据按8字节对齐 */
+    uint64_t dataBase = (strBase + strings.size() + 7) / 8 * 8;
+    strings.resize(dataBase - strBase, '\0');
+    for(size_t i = 0; i < files.size(); i++) {
+        BundleEntry& e = entries[i];
+        e.dataOff = dataBase + data.size(); e.dataLen = files[i].data.size();
+        data += files[i].data;
+        data.resize((data.size() + 7) / 8 * 8, '\0');
+        e.gzipOff = dataBase + data.size(); e.gzipLen = files[i].gzip.size();
+        data += files[i].gzip;
+        data.resize((data.size() + 7) / 8 * 8, '\0');
+    }
+
+    string tmp = string(argv[2]) + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if(!fp) {
+        fprintf(stderr, "open %s failed\n", tmp.c_str());
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && (entries.empty() || fwrite(entries.data(), sizeof(BundleEntry), entries.size(), fp) == entries.size())
+        && fwrite(strings.data(), 1, strings.size(), fp) == strings.size()
+        && fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = (fclose(fp) == 0) && ok;
+    /* 原子替换, 运行中的服务器仍映射着旧文件 */
+    if(!ok || rename(tmp.c_str(), argv[2]) < 0) {
+        fprintf(stderr, "write %s failed\n", argv[2]);
+        unlink(tmp.c_str());
+        return 1;
+    }
+    printf("packed %zu files into %s (%zu bytes)\n", files.size(), argv[2],
+           (size_t)(dataBase + data.size()));
+    return 0;
+}